@@ -0,0 +1,187 @@
+#include "assemble.h"
+#include "eval.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// just enough x86-64 to patch around a bug: instructions separated by ';',
+// registers with or without the $, addresses and immediates as expressions
+
+static const char *register_names[] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15",
+};
+
+static const struct {
+  const char *mnemonic;
+  uint8_t code[2];
+  uint8_t length;
+} simple[] = {
+    {"nop", {0x90}, 1},  {"int3", {0xcc}, 1},       {"ret", {0xc3}, 1},
+    {"leave", {0xc9}, 1}, {"syscall", {0x0f, 0x05}, 2},
+};
+
+#define REX_W 0x48
+#define REX_B 0x01
+#define REX_R 0x04
+
+static char *trim(char *text) {
+  while (isspace(*text))
+    text++;
+  char *end = text + strlen(text);
+  while (end > text && isspace(end[-1]))
+    *--end = '\0';
+  return text;
+}
+
+static int parse_register(char *text) {
+  text = trim(text);
+  if (*text == '$')
+    text++;
+  for (size_t i = 0; i < sizeof(register_names) / sizeof(register_names[0]);
+       i++) {
+    if (strcmp(text, register_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static bool fits_int32(int64_t value) {
+  return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static size_t emit(uint8_t *code, size_t at, const void *bytes,
+                   size_t length) {
+  if (at + length > MAX_PATCH_LENGTH)
+    return 0;
+  memcpy(code + at, bytes, length);
+  return length;
+}
+
+// jmp and call, relative to the end of the instruction
+static size_t assemble_branch(bool is_call, char *operand, uint64_t address,
+                              uint8_t *code, size_t at) {
+  int64_t target;
+  if (!eval_string(operand, &target))
+    return 0;
+
+  int64_t short_offset = target - (int64_t)(address + 2);
+  if (!is_call && short_offset >= INT8_MIN && short_offset <= INT8_MAX) {
+    uint8_t bytes[] = {0xeb, (uint8_t)short_offset};
+    return emit(code, at, bytes, sizeof(bytes));
+  }
+
+  int64_t offset = target - (int64_t)(address + 5);
+  if (!fits_int32(offset))
+    return 0;
+  uint8_t bytes[5] = {is_call ? 0xe8 : 0xe9};
+  int32_t offset32 = offset;
+  memcpy(bytes + 1, &offset32, sizeof(offset32));
+  return emit(code, at, bytes, sizeof(bytes));
+}
+
+static size_t assemble_mov(char *operands, uint8_t *code, size_t at) {
+  char *comma = strchr(operands, ',');
+  if (!comma)
+    return 0;
+  *comma = '\0';
+
+  int reg = parse_register(operands);
+  int64_t value;
+  if (reg == -1 || !eval_string(comma + 1, &value))
+    return 0;
+
+  uint8_t rex = REX_W | (reg >= 8 ? REX_B : 0);
+  if (fits_int32(value)) {
+    uint8_t bytes[7] = {rex, 0xc7, 0xc0 | (reg & 7)};
+    int32_t value32 = value;
+    memcpy(bytes + 3, &value32, sizeof(value32));
+    return emit(code, at, bytes, sizeof(bytes));
+  }
+  uint8_t bytes[10] = {rex, 0xb8 | (reg & 7)};
+  memcpy(bytes + 2, &value, sizeof(value));
+  return emit(code, at, bytes, sizeof(bytes));
+}
+
+static size_t assemble_xor(char *operands, uint8_t *code, size_t at) {
+  char *comma = strchr(operands, ',');
+  if (!comma)
+    return 0;
+  *comma = '\0';
+
+  int dst = parse_register(operands);
+  int src = parse_register(comma + 1);
+  if (dst == -1 || src == -1)
+    return 0;
+
+  uint8_t bytes[] = {
+      REX_W | (src >= 8 ? REX_R : 0) | (dst >= 8 ? REX_B : 0),
+      0x31,
+      0xc0 | (src & 7) << 3 | (dst & 7),
+  };
+  return emit(code, at, bytes, sizeof(bytes));
+}
+
+static size_t assemble_stack(bool is_pop, char *operand, uint8_t *code,
+                             size_t at) {
+  int reg = parse_register(operand);
+  if (reg == -1)
+    return 0;
+
+  uint8_t opcode = (is_pop ? 0x58 : 0x50) | (reg & 7);
+  if (reg < 8)
+    return emit(code, at, &opcode, 1);
+  uint8_t bytes[] = {0x41, opcode};
+  return emit(code, at, bytes, sizeof(bytes));
+}
+
+static size_t assemble_one(char *line, uint64_t address, uint8_t *code,
+                           size_t at) {
+  char *mnemonic = trim(line);
+  char *operands = mnemonic + strcspn(mnemonic, " \t");
+  if (*operands)
+    *operands++ = '\0';
+
+  for (size_t i = 0; i < sizeof(simple) / sizeof(simple[0]); i++) {
+    if (strcmp(mnemonic, simple[i].mnemonic) == 0)
+      return emit(code, at, simple[i].code, simple[i].length);
+  }
+
+  if (strcmp(mnemonic, "jmp") == 0 || strcmp(mnemonic, "call") == 0)
+    return assemble_branch(mnemonic[0] == 'c', operands, address, code, at);
+  if (strcmp(mnemonic, "mov") == 0)
+    return assemble_mov(operands, code, at);
+  if (strcmp(mnemonic, "xor") == 0)
+    return assemble_xor(operands, code, at);
+  if (strcmp(mnemonic, "push") == 0 || strcmp(mnemonic, "pop") == 0)
+    return assemble_stack(mnemonic[1] == 'o', operands, code, at);
+  return 0;
+}
+
+// returns the length of the code, 0 when some instruction didn't assemble
+size_t assemble(char *source, uint64_t address, uint8_t *code) {
+  size_t length = 0;
+  char *next = source;
+
+  while (next) {
+    char *line = next;
+    next = strchr(line, ';');
+    if (next)
+      *next++ = '\0';
+    if (*trim(line) == '\0')
+      continue;
+
+    // assembling takes the line apart
+    char text[64];
+    snprintf(text, sizeof(text), "%s", trim(line));
+
+    size_t size = assemble_one(line, address + length, code, length);
+    if (size == 0) {
+      printf("? Can't assemble '%s'.\n", text);
+      return 0;
+    }
+    length += size;
+  }
+  return length;
+}
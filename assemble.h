@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_PATCH_LENGTH 64
+
+size_t assemble(char *source, uint64_t address, uint8_t *code);
@@ -0,0 +1,368 @@
+#include "commands.h"
+#include "disassembler.h"
+#include "eval.h"
+#include "memory.h"
+#include "parser.h"
+#include "render.h"
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/personality.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// run from bench/, where make puts everything
+#define DEBOOGER "./debooger"
+#define TRACEES "tracees/"
+#define RESULTS "results.json"
+#define BASELINE "baseline.json"
+
+#define HEAP_ADDRESS 0x200000000
+#define HEAP_SIZE (64 << 20)
+
+// a metric may get this much worse than the baseline before we complain
+#define TOLERANCE 0.10
+
+#define MAX_METRICS 32
+
+// sessions are noisy, keep the best of this many
+#define REPEATS 3
+
+extern struct user_regs_struct regs;
+extern int debooger_main(int argc, char *argv[]);
+
+struct Metric {
+  const char *name;
+  double value;
+  bool higher_is_better;
+};
+
+static struct Metric metrics[MAX_METRICS];
+static size_t metrics_count = 0;
+
+static void report(const char *name, double value, bool higher_is_better) {
+  metrics[metrics_count++] = (struct Metric){name, value, higher_is_better};
+  printf("   %-32s %14.1f %s\n", name, value,
+         higher_is_better ? "(higher is better)" : "(lower is better)");
+  fflush(stdout);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *write_script(const char *first, const char *repeat, size_t count) {
+  char *path = strdup("/tmp/debooger-bench-XXXXXX");
+
+  int fd = mkstemp(path);
+  FILE *file = fdopen(fd, "w");
+  fputs(first, file);
+  // an empty line repeats the previous command
+  for (size_t i = 0; i < count; i++)
+    fputs(repeat, file);
+  fclose(file);
+
+  return path;
+}
+
+static uint64_t symbol_address(const char *binary, const char *symbol) {
+  char command[256];
+  snprintf(command, sizeof(command), "nm %s | grep ' T %s$'", binary, symbol);
+
+  FILE *nm = popen(command, "r");
+  uint64_t address = 0;
+  if (fscanf(nm, "%lx", &address) != 1)
+    fprintf(stderr, "? Can't find %s in %s.\n", symbol, binary);
+  pclose(nm);
+
+  return address;
+}
+
+static uint64_t stats_field(const char *path, const char *field) {
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return 0;
+
+  char buffer[4096];
+  size_t len = fread(buffer, 1, sizeof(buffer) - 1, file);
+  buffer[len] = '\0';
+  fclose(file);
+
+  char key[64];
+  snprintf(key, sizeof(key), "\"%s\": ", field);
+  char *at = strstr(buffer, key);
+  return at ? strtoull(at + strlen(key), NULL, 10) : 0;
+}
+
+// runs a whole debooger session against a tracee, returns the wall time.
+// Interactive sessions read the script from stdin and draw the stop view
+static double run_session(const char *tracee, const char *script,
+                          bool is_interactive, const char *stats_path) {
+  double start = now();
+
+  pid_t child = fork();
+  if (child == 0) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+
+    if (is_interactive) {
+      int script_fd = open(script, O_RDONLY);
+      dup2(script_fd, STDIN_FILENO);
+      execl(DEBOOGER, DEBOOGER, "-s", stats_path, tracee, NULL);
+    } else {
+      execl(DEBOOGER, DEBOOGER, "-x", script, "-s", stats_path, tracee, NULL);
+    }
+    exit(127);
+  }
+
+  waitpid(child, NULL, 0);
+  return now() - start;
+}
+
+static double startup_time;
+
+static void bench_stops(const char *name, const char *tracee,
+                        const char *first, const char *repeat, size_t count) {
+  const char *stats_path = "/tmp/debooger-bench-stats.json";
+  char *script = write_script(first, repeat, count);
+
+  double elapsed = INFINITY;
+  for (int i = 0; i < REPEATS; i++)
+    elapsed = fmin(elapsed, run_session(tracee, script, false, stats_path));
+  report(name, count / (elapsed - startup_time), true);
+
+  unlink(script);
+  unlink(stats_path);
+  free(script);
+}
+
+static void bench_sessions(void) {
+  char *script = write_script("q\n", "", 0);
+  startup_time = INFINITY;
+  for (int i = 0; i < REPEATS; i++)
+    startup_time =
+        fmin(startup_time, run_session(TRACEES "loop", script, false, "/dev/null"));
+  unlink(script);
+  free(script);
+
+  puts("sessions:");
+
+  bench_stops("step_stops_per_sec", TRACEES "loop", "s\n", "\n", 20000);
+  bench_stops("deep_stack_step_stops_per_sec", TRACEES "recursion", "s\n",
+              "\n", 20000);
+  bench_stops("threaded_step_stops_per_sec", TRACEES "threads", "s\n", "\n",
+              5000);
+  bench_stops("syscall_stops_per_sec", TRACEES "syscalls", "g\n", "\n", 20000);
+
+  char first[64];
+  snprintf(first, sizeof(first), "b 0x%lx\nc\n",
+           symbol_address(TRACEES "loop", "tick"));
+  bench_stops("breakpoint_stops_per_sec", TRACEES "loop", first, "\n", 20000);
+
+  bench_stops("examine_per_sec", TRACEES "loop", "x $rsp\n", "\n", 20000);
+
+  // the same stepping, but drawing the full stop view every time
+  const char *stats_path = "/tmp/debooger-bench-stats.json";
+  size_t count = 2000;
+  script = write_script("s\n", "\n", count);
+  run_session(TRACEES "loop", script, true, stats_path);
+  report("stop_render_ns", stats_field(stats_path, "render") / (double)count,
+         false);
+  unlink(script);
+  unlink(stats_path);
+  free(script);
+}
+
+static pid_t start_heap_tracee(void) {
+  pid_t child = fork();
+  if (child == 0) {
+    personality(ADDR_NO_RANDOMIZE);
+    ptrace(PTRACE_TRACEME, 0, 0, 0);
+    execl(TRACEES "heap", TRACEES "heap", NULL);
+    exit(127);
+  }
+
+  // past the exec stop and on to the trap once the heap is filled in
+  int status;
+  waitpid(child, &status, 0);
+  ptrace(PTRACE_SETOPTIONS, child, 0, PTRACE_O_EXITKILL);
+  ptrace(PTRACE_CONT, child, 0, 0);
+  waitpid(child, &status, 0);
+
+  return child;
+}
+
+static void bench_memory(void) {
+  puts("memory:");
+
+  pid_t child = start_heap_tracee();
+  static uint8_t buffer[HEAP_SIZE];
+  // fault our side in up front so only the tracee's side is measured
+  memset(buffer, 0, sizeof(buffer));
+
+  // what x does, a word at a time
+  size_t peek_size = 4 << 20;
+  double start = now();
+  for (size_t i = 0; i < peek_size; i += 8) {
+    uint64_t word = ptrace(PTRACE_PEEKDATA, child, HEAP_ADDRESS + i, 0);
+    memcpy(buffer + i, &word, sizeof(word));
+  }
+  report("peekdata_mb_per_sec", peek_size / (now() - start) / (1 << 20), true);
+
+  start = now();
+  for (size_t i = 0; i < HEAP_SIZE; i += 1 << 20)
+    read_memory(child, HEAP_ADDRESS + i, buffer + i, 1 << 20);
+  report("bulk_read_mb_per_sec", HEAP_SIZE / (now() - start) / (1 << 20),
+         true);
+
+  kill(child, SIGKILL);
+  waitpid(child, NULL, 0);
+}
+
+// a fast parser is no use if it gets the answer wrong
+static const struct {
+  const char *line;
+  int64_t value;
+} expressions[] = {
+    // the + before a parenthesised operand used to go missing
+    {"e 1 + 2 * (3)", 7},
+    {"e 2 * 3 + 4", 10},
+    {"e (1 + 2) * 3", 9},
+    {"e 10 - 4 - 3", 3},
+    {"e $rax + 0x10 * ($rsp - 8) / 2 - $rax", 0x3fffffffeffc0},
+};
+
+static bool check_expressions(void) {
+  regs.rax = 0x1000;
+  regs.rsp = 0x7fffffffe000;
+
+  bool is_correct = true;
+  for (size_t i = 0; i < sizeof(expressions) / sizeof(*expressions); i++) {
+    char line[64];
+    snprintf(line, sizeof(line), "%s", expressions[i].line);
+    struct CommandInstance instance = parse_cmd(line);
+    int64_t value = 0;
+    if (instance.arg) {
+      eval(instance.arg, &regs, &value);
+      free_node(instance.arg);
+    }
+    if (!instance.arg || value != expressions[i].value) {
+      printf("? %s gave 0x%lx, expected 0x%lx.\n", expressions[i].line, value,
+             expressions[i].value);
+      is_correct = false;
+    }
+  }
+  return is_correct;
+}
+
+static void bench_micro(void) {
+  puts("micro:");
+
+  // the disassembly pane, minus the terminal
+  uint8_t code[DISASSEMBLY_LINES * MAX_INSTRUCTION_LENGTH];
+  memcpy(code, (void *)debooger_main, sizeof(code));
+
+  fflush(stdout);
+  int stdout_fd = dup(STDOUT_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDOUT_FILENO);
+
+  size_t count = 20000;
+  double start = now();
+  for (size_t i = 0; i < count; i++) {
+    frame_begin(100, 80);
+    disassemble(code, (uint64_t)debooger_main);
+    frame_end();
+  }
+  double elapsed = now() - start;
+
+  fflush(stdout);
+  dup2(stdout_fd, STDOUT_FILENO);
+  close(null_fd);
+  close(stdout_fd);
+
+  report("disassemble_per_sec", count / elapsed, true);
+
+  regs.rax = 0x1000;
+  regs.rsp = 0x7fffffffe000;
+
+  count = 1000000;
+  start = now();
+  for (size_t i = 0; i < count; i++) {
+    char line[] = "e $rax + 0x10 * ($rsp - 8) / 2 - $rax";
+    struct CommandInstance instance = parse_cmd(line);
+    int64_t value;
+    eval(instance.arg, &regs, &value);
+    free_node(instance.arg);
+  }
+  report("parse_eval_ns", (now() - start) * 1e9 / count, false);
+}
+
+static void write_results(void) {
+  FILE *file = fopen(RESULTS, "w");
+  fputs("{\n", file);
+  for (size_t i = 0; i < metrics_count; i++) {
+    fprintf(file, "  \"%s\": %.1f%s\n", metrics[i].name, metrics[i].value,
+            i + 1 < metrics_count ? "," : "");
+  }
+  fputs("}\n", file);
+  fclose(file);
+}
+
+// the baseline is a results.json from an earlier run, one metric per line
+static int compare_baseline(void) {
+  FILE *file = fopen(BASELINE, "r");
+  if (!file) {
+    printf("no " BASELINE ", copy " RESULTS " there to start comparing.\n");
+    return 0;
+  }
+
+  int regressions = 0;
+  char line[256];
+
+  puts("against baseline:");
+  while (fgets(line, sizeof(line), file)) {
+    char name[64];
+    double baseline;
+    if (sscanf(line, " \"%63[^\"]\": %lf", name, &baseline) != 2)
+      continue;
+
+    for (size_t i = 0; i < metrics_count; i++) {
+      if (strcmp(metrics[i].name, name) != 0)
+        continue;
+
+      double ratio = metrics[i].value / baseline;
+      bool is_worse = metrics[i].higher_is_better ? ratio < 1 - TOLERANCE
+                                                  : ratio > 1 + TOLERANCE;
+      printf("   %-32s %+6.1f%%%s\n", name, (ratio - 1) * 100,
+             is_worse ? "  <- regression" : "");
+      regressions += is_worse;
+    }
+  }
+
+  fclose(file);
+  return regressions;
+}
+
+int main(void) {
+  if (!check_expressions())
+    return 1;
+
+  bench_sessions();
+  bench_memory();
+  bench_micro();
+
+  write_results();
+  return compare_baseline() ? 1 : 0;
+}
@@ -0,0 +1,23 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// a large populated heap at a known address, then a trap so the
+// benchmark can read it
+#define HEAP_ADDRESS 0x200000000
+#define HEAP_SIZE (64 << 20)
+
+int main(void) {
+  uint8_t *heap = mmap((void *)HEAP_ADDRESS, HEAP_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (heap == MAP_FAILED)
+    return 1;
+
+  for (size_t i = 0; i < HEAP_SIZE; i++)
+    heap[i] = i;
+
+  __asm__ volatile("int3");
+
+  while (1)
+    ;
+}
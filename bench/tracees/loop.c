@@ -0,0 +1,10 @@
+// tight loop around a call we can put a breakpoint on
+__attribute__((noinline)) void tick(volatile unsigned long *counter) {
+  (*counter)++;
+}
+
+int main(void) {
+  volatile unsigned long counter = 0;
+  while (1)
+    tick(&counter);
+}
@@ -0,0 +1,13 @@
+// keeps the stack tens of thousands of frames deep
+__attribute__((noinline)) unsigned long descend(unsigned long depth) {
+  if (depth == 0)
+    return 0;
+  return descend(depth - 1) + 1;
+}
+
+int main(void) {
+  volatile unsigned long sink;
+  while (1)
+    sink = descend(50000);
+  (void)sink;
+}
@@ -0,0 +1,7 @@
+#include <unistd.h>
+
+// every iteration is a syscall entry and exit stop under PTRACE_SYSCALL
+int main(void) {
+  while (1)
+    getppid();
+}
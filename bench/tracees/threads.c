@@ -0,0 +1,20 @@
+#include <pthread.h>
+
+#define THREADS 32
+
+static void *spin(void *arg) {
+  volatile unsigned long *counter = arg;
+  while (1)
+    (*counter)++;
+  return NULL;
+}
+
+int main(void) {
+  static volatile unsigned long counters[THREADS];
+  pthread_t threads[THREADS];
+
+  for (int i = 0; i < THREADS; i++)
+    pthread_create(&threads[i], NULL, spin, (void *)&counters[i]);
+
+  spin((void *)&counters[0]);
+}
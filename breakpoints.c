@@ -1,4 +1,5 @@
 #include "breakpoints.h"
+#include "stats.h"
 #include <assert.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -10,6 +11,8 @@
 struct Breakpoint {
   uint64_t address;
   bool is_enabled;
+  enum BreakpointKind kind;
+  uint8_t length;
 };
 
 enum DebugReg : uint8_t {
@@ -23,8 +26,6 @@ enum DebugReg : uint8_t {
   DR7,
 };
 
-#define MAX_BREAKPOINTS 4
-
 static struct Breakpoint *breakpoints[MAX_BREAKPOINTS];
 
 static struct Breakpoint **find_free_slot(void) {
@@ -36,12 +37,11 @@ static struct Breakpoint **find_free_slot(void) {
   return NULL;
 }
 
-void add_breakpoint(int pid, uint64_t address) {
+int set_breakpoint(int pid, uint64_t address, enum BreakpointKind kind,
+                   uint8_t length) {
   struct Breakpoint **bpp = find_free_slot();
-  if (!bpp) {
-    puts("? No free breakpoint slots.");
-    return;
-  }
+  if (!bpp)
+    return -1;
 
   *bpp = malloc(sizeof(struct Breakpoint));
   assert(*bpp);
@@ -50,6 +50,24 @@ void add_breakpoint(int pid, uint64_t address) {
 
   bp->address = address;
   bp->is_enabled = true;
+  bp->kind = kind;
+  bp->length = kind == BP_EXECUTE ? 1 : length;
+
+  return bpp - breakpoints;
+}
+
+void add_breakpoint(int pid, uint64_t address) {
+  if (set_breakpoint(pid, address, BP_EXECUTE, 1) == -1)
+    puts("? No free breakpoint slots.");
+}
+
+int find_breakpoint(uint64_t address, enum BreakpointKind kind) {
+  for (size_t i = 0; i < MAX_BREAKPOINTS; i++) {
+    if (breakpoints[i] && breakpoints[i]->address == address &&
+        breakpoints[i]->kind == kind)
+      return i;
+  }
+  return -1;
 }
 
 void remove_breakpoint(int pid, uint8_t id) {
@@ -64,8 +82,11 @@ void list_breakpoints(int pid) {
   for (size_t i = 0; i < MAX_BREAKPOINTS; i++) {
     if (!breakpoints[i])
       continue;
-    printf("Breakpoint #%zu: %p (%s)\n", i, (void *)breakpoints[i]->address,
-           breakpoints[i]->is_enabled ? "enabled" : "disabled");
+    const char *kind = breakpoints[i]->kind == BP_WRITE    ? "write watch, "
+                       : breakpoints[i]->kind == BP_ACCESS ? "access watch, "
+                                                           : "";
+    printf("Breakpoint #%zu: %p (%s%s)\n", i, (void *)breakpoints[i]->address,
+           kind, breakpoints[i]->is_enabled ? "enabled" : "disabled");
   }
 }
 
@@ -99,6 +120,36 @@ void free_breakpoints(int pid) {
   }
 }
 
+// saved holds MAX_BREAKPOINTS
+size_t save_breakpoints(struct SavedBreakpoint *saved) {
+  size_t count = 0;
+  for (size_t i = 0; i < MAX_BREAKPOINTS; i++) {
+    if (!breakpoints[i])
+      continue;
+
+    struct Breakpoint *bp = breakpoints[i];
+    saved[count++] = (struct SavedBreakpoint){bp->address, bp->kind,
+                                              bp->length, bp->is_enabled};
+  }
+  return count;
+}
+
+// they make it into the debug registers on the next resume
+void restore_breakpoints(int pid, const struct SavedBreakpoint *saved,
+                         size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (find_breakpoint(saved[i].address, saved[i].kind) != -1)
+      continue;
+
+    int id = set_breakpoint(pid, saved[i].address, saved[i].kind,
+                            saved[i].length);
+    if (id == -1)
+      break;
+    if (!saved[i].is_enabled)
+      disable_breakpoint(pid, id);
+  }
+}
+
 const uint8_t DR7_LEN_BIT[] = {19, 23, 27, 31};
 const uint8_t DR7_RW_BIT[] = {17, 21, 25, 29};
 const uint8_t DR7_LE_BIT[] = {0, 2, 4, 6};
@@ -107,14 +158,28 @@ const uint8_t DR7_GE_BIT[] = {1, 3, 5, 7};
 #define DR7_LEN_SIZE 2
 #define DR7_RW_SIZE 2
 
+// DR7 LEN field for 1, 2, 4 and 8 byte watchpoints
+static inline uint32_t len_bits(uint8_t length) {
+  switch (length) {
+  case 2:
+    return 0b01;
+  case 4:
+    return 0b11;
+  case 8:
+    return 0b10;
+  default:
+    return 0b00;
+  }
+}
+
 #define DR_OFFSET(dr) ((((struct user *)0)->u_debugreg) + (dr))
 
 static inline uint64_t get_reg(int pid, enum DebugReg reg) {
-  return ptrace(PTRACE_PEEKUSER, pid, DR_OFFSET(reg), 0);
+  return PTRACE(PTRACE_PEEKUSER, pid, DR_OFFSET(reg), 0);
 }
 
 static inline void set_reg(int pid, enum DebugReg reg, uint64_t value) {
-  ptrace(PTRACE_POKEUSER, pid, DR_OFFSET(reg), value);
+  PTRACE(PTRACE_POKEUSER, pid, DR_OFFSET(reg), value);
 }
 
 static inline void set_bit(uint32_t *val, uint32_t set_val, uint8_t start_bit,
@@ -145,8 +210,8 @@ void apply_breakpoints(int pid) {
 
     struct Breakpoint *bp = breakpoints[i];
 
-    set_bit(&dr7, 0, DR7_LEN_BIT[i], DR7_LEN_SIZE);
-    set_bit(&dr7, 0, DR7_RW_BIT[i], DR7_LEN_SIZE);
+    set_bit(&dr7, len_bits(bp->length), DR7_LEN_BIT[i], DR7_LEN_SIZE);
+    set_bit(&dr7, bp->kind, DR7_RW_BIT[i], DR7_RW_SIZE);
     set_bit(&dr7, 1, DR7_LE_BIT[i], 1);
 
     switch (i) {
@@ -167,3 +232,18 @@ void apply_breakpoints(int pid) {
 
   set_reg(pid, DR7, dr7);
 }
+
+// the breakpoint whose B0-B3 bit is set in DR6, or -1. DR6 gets cleared so
+// the next trap doesn't report it again
+int take_hit_breakpoint(int pid) {
+  uint32_t dr6 = get_reg(pid, DR6);
+  int id = -1;
+  for (size_t i = 0; i < MAX_BREAKPOINTS && id == -1; i++) {
+    if (get_bit(dr6, i) && breakpoints[i])
+      id = i;
+  }
+
+  if (dr6)
+    set_reg(pid, DR6, 0);
+  return id;
+}
@@ -1,12 +1,37 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+// matches the DR7 R/W field encoding
+enum BreakpointKind : uint8_t {
+  BP_EXECUTE = 0,
+  BP_WRITE = 1,
+  BP_ACCESS = 3,
+};
+
+#define MAX_BREAKPOINTS 4
+
+// what a session file keeps of a breakpoint
+struct SavedBreakpoint {
+  uint64_t address;
+  enum BreakpointKind kind;
+  uint8_t length;
+  bool is_enabled;
+};
+
 void add_breakpoint(int pid, uint64_t address);
+int set_breakpoint(int pid, uint64_t address, enum BreakpointKind kind,
+                   uint8_t length);
+int find_breakpoint(uint64_t address, enum BreakpointKind kind);
 void remove_breakpoint(int pid, uint8_t id);
 void list_breakpoints(int pid);
 void enable_breakpoint(int pid, uint8_t id);
 void disable_breakpoint(int pid, uint8_t id);
 void free_breakpoints(int pid);
 void apply_breakpoints(int pid);
+int take_hit_breakpoint(int pid);
+size_t save_breakpoints(struct SavedBreakpoint *saved);
+void restore_breakpoints(int pid, const struct SavedBreakpoint *saved,
+                         size_t count);
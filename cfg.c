@@ -0,0 +1,559 @@
+#include "cfg.h"
+#include "memory.h"
+#include "symbols.h"
+#include "ui.h"
+#include <assert.h>
+#include <capstone/capstone.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// past this the symbol size is more likely wrong than the function that big
+#define MAX_FUNCTION_BYTES (1 << 16)
+#define NO_BLOCK -1
+
+struct Block {
+  uint64_t start;
+  uint64_t end;
+  // the instruction that ends it
+  uint64_t last;
+  size_t instructions;
+  // where it goes next, with the block when that's inside the function
+  uint64_t targets[2];
+  int successors[2];
+  uint8_t target_count;
+  bool is_return;
+  // through a register or a table, nobody knows where
+  bool is_indirect;
+};
+
+// a back edge's header and every block reaching the edge without going
+// through the header
+struct Loop {
+  int header;
+  uint64_t *members;
+  size_t size;
+  size_t depth;
+};
+
+struct Cfg {
+  struct Function function;
+  // what got decoded, once it differs the graph is stale
+  uint8_t *code;
+  struct Block *blocks;
+  size_t count;
+  // immediate dominators, NO_BLOCK for what the entry can't reach
+  int *idom;
+  struct Loop *loops;
+  size_t loop_count;
+};
+
+// blocks with the predecessors of block i at preds[start[i]..start[i + 1]]
+struct Predecessors {
+  size_t *start;
+  int *preds;
+};
+
+// graphs stay around until the code they were built from changes
+static struct {
+  struct Cfg **cfgs;
+  size_t count;
+  size_t capacity;
+} cache;
+
+static bool is_member(const struct Loop *loop, int block) {
+  return loop->members[block / 64] >> (block % 64) & 1;
+}
+
+static void add_member(struct Loop *loop, int block) {
+  loop->members[block / 64] |= 1ull << (block % 64);
+  loop->size++;
+}
+
+static int find_block(const struct Cfg *cfg, uint64_t address) {
+  size_t low = 0, high = cfg->count;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (address < cfg->blocks[mid].start)
+      high = mid;
+    else if (address >= cfg->blocks[mid].end)
+      low = mid + 1;
+    else
+      return mid;
+  }
+  return NO_BLOCK;
+}
+
+static bool is_terminator(const cs_insn *insn) {
+  return strcmp(insn->mnemonic, "hlt") == 0 ||
+         strcmp(insn->mnemonic, "ud2") == 0;
+}
+
+// a direct branch has the target as its only operand
+static bool branch_target(const cs_insn *insn, uint64_t *target) {
+  const cs_x86 *x86 = &insn->detail->x86;
+  if (x86->op_count != 1 || x86->operands[0].type != X86_OP_IMM)
+    return false;
+  *target = x86->operands[0].imm;
+  return true;
+}
+
+// what the last instruction of a block says about where it goes
+static void note_exit(csh handle, const struct Cfg *cfg, const cs_insn *insn,
+                      struct Block *block) {
+  uint64_t next = insn->address + insn->size;
+  uint64_t target;
+
+  block->target_count = 0;
+  block->is_return = cs_insn_group(handle, insn, CS_GRP_RET);
+  block->is_indirect = false;
+  if (block->is_return || is_terminator(insn))
+    return;
+
+  if (cs_insn_group(handle, insn, CS_GRP_JUMP)) {
+    if (branch_target(insn, &target))
+      block->targets[block->target_count++] = target;
+    else
+      block->is_indirect = true;
+    if (insn->id == X86_INS_JMP)
+      return;
+  }
+  // calls come back, except the noreturn ones at the very end
+  if (next < cfg->function.end)
+    block->targets[block->target_count++] = next;
+}
+
+// leaders are the entry, branch targets and whatever follows a branch
+static void find_blocks(struct Cfg *cfg, csh handle, const cs_insn *insns,
+                        size_t count) {
+  uint64_t start = cfg->function.start;
+  bool *is_leader = calloc(cfg->function.end - start, sizeof(bool));
+  assert(is_leader);
+  is_leader[0] = true;
+
+  for (size_t i = 0; i < count; i++) {
+    bool is_jump = cs_insn_group(handle, &insns[i], CS_GRP_JUMP);
+    if (!is_jump && !cs_insn_group(handle, &insns[i], CS_GRP_RET) &&
+        !is_terminator(&insns[i]))
+      continue;
+
+    uint64_t target;
+    if (is_jump && branch_target(&insns[i], &target) && target >= start &&
+        target < cfg->function.end)
+      is_leader[target - start] = true;
+    uint64_t next = insns[i].address + insns[i].size;
+    if (next < cfg->function.end)
+      is_leader[next - start] = true;
+  }
+
+  cfg->blocks = calloc(count, sizeof(struct Block));
+  assert(cfg->blocks);
+  struct Block *block = NULL;
+  for (size_t i = 0; i < count; i++) {
+    if (!block || is_leader[insns[i].address - start])
+      block = &cfg->blocks[cfg->count++];
+    if (block->instructions++ == 0)
+      block->start = insns[i].address;
+    block->end = insns[i].address + insns[i].size;
+    block->last = insns[i].address;
+    note_exit(handle, cfg, &insns[i], block);
+  }
+  free(is_leader);
+
+  for (size_t i = 0; i < cfg->count; i++) {
+    struct Block *block = &cfg->blocks[i];
+    for (size_t j = 0; j < block->target_count; j++)
+      block->successors[j] = find_block(cfg, block->targets[j]);
+  }
+}
+
+// reverse postorder from the entry, the unreachable blocks left out
+static size_t order_blocks(const struct Cfg *cfg, int *order, int *rank) {
+  int *stack = malloc(cfg->count * sizeof(int));
+  uint8_t *next = calloc(cfg->count, sizeof(uint8_t));
+  assert(stack && next);
+
+  for (size_t i = 0; i < cfg->count; i++)
+    rank[i] = NO_BLOCK;
+  size_t depth = 0, done = 0;
+  stack[depth++] = 0;
+  rank[0] = 0;
+
+  while (depth > 0) {
+    int top = stack[depth - 1];
+    const struct Block *block = &cfg->blocks[top];
+    if (next[top] < block->target_count) {
+      int successor = block->successors[next[top]++];
+      if (successor != NO_BLOCK && rank[successor] == NO_BLOCK) {
+        rank[successor] = 0;
+        stack[depth++] = successor;
+      }
+      continue;
+    }
+    order[done++] = top;
+    depth--;
+  }
+  free(stack);
+  free(next);
+
+  for (size_t i = 0; i < done / 2; i++) {
+    int swap = order[i];
+    order[i] = order[done - 1 - i];
+    order[done - 1 - i] = swap;
+  }
+  for (size_t i = 0; i < done; i++)
+    rank[order[i]] = i;
+  return done;
+}
+
+static void find_predecessors(const struct Cfg *cfg, const int *rank,
+                              struct Predecessors *preds) {
+  preds->start = calloc(cfg->count + 1, sizeof(size_t));
+  assert(preds->start);
+  for (size_t i = 0; i < cfg->count; i++) {
+    for (size_t j = 0; rank[i] != NO_BLOCK &&
+                       j < cfg->blocks[i].target_count; j++) {
+      if (cfg->blocks[i].successors[j] != NO_BLOCK)
+        preds->start[cfg->blocks[i].successors[j] + 1]++;
+    }
+  }
+  for (size_t i = 0; i < cfg->count; i++)
+    preds->start[i + 1] += preds->start[i];
+
+  preds->preds = malloc((preds->start[cfg->count] + 1) * sizeof(int));
+  size_t *filled = calloc(cfg->count, sizeof(size_t));
+  assert(preds->preds && filled);
+  for (size_t i = 0; i < cfg->count; i++) {
+    for (size_t j = 0; rank[i] != NO_BLOCK &&
+                       j < cfg->blocks[i].target_count; j++) {
+      int successor = cfg->blocks[i].successors[j];
+      if (successor != NO_BLOCK)
+        preds->preds[preds->start[successor] + filled[successor]++] = i;
+    }
+  }
+  free(filled);
+}
+
+static int intersect(const int *idom, const int *rank, int a, int b) {
+  while (a != b) {
+    while (rank[a] > rank[b])
+      a = idom[a];
+    while (rank[b] > rank[a])
+      b = idom[b];
+  }
+  return a;
+}
+
+// Cooper, Harvey and Kennedy's iteration, a few passes over the reverse
+// postorder settle it for the graphs compilers emit
+static void find_dominators(struct Cfg *cfg, const int *order, size_t reached,
+                            const int *rank,
+                            const struct Predecessors *preds) {
+  cfg->idom = malloc(cfg->count * sizeof(int));
+  assert(cfg->idom);
+  for (size_t i = 0; i < cfg->count; i++)
+    cfg->idom[i] = NO_BLOCK;
+  cfg->idom[0] = 0;
+
+  bool is_changed = true;
+  while (is_changed) {
+    is_changed = false;
+    for (size_t i = 1; i < reached; i++) {
+      int block = order[i];
+      int idom = NO_BLOCK;
+      for (size_t j = preds->start[block]; j < preds->start[block + 1]; j++) {
+        int pred = preds->preds[j];
+        if (cfg->idom[pred] == NO_BLOCK)
+          continue;
+        idom = idom == NO_BLOCK ? pred : intersect(cfg->idom, rank, pred, idom);
+      }
+      if (idom != cfg->idom[block]) {
+        cfg->idom[block] = idom;
+        is_changed = true;
+      }
+    }
+  }
+}
+
+static bool dominates(const struct Cfg *cfg, int a, int b) {
+  while (b != a && b != 0)
+    b = cfg->idom[b];
+  return b == a;
+}
+
+// loops sharing a header are one loop
+static struct Loop *loop_at(struct Cfg *cfg, int header) {
+  for (size_t i = 0; i < cfg->loop_count; i++) {
+    if (cfg->loops[i].header == header)
+      return &cfg->loops[i];
+  }
+
+  struct Loop *loop = &cfg->loops[cfg->loop_count++];
+  loop->header = header;
+  loop->members = calloc((cfg->count + 63) / 64, sizeof(uint64_t));
+  assert(loop->members);
+  add_member(loop, header);
+  return loop;
+}
+
+// an edge to a block dominating its source is a back edge, the loop is what
+// walking backwards from there finds before the header
+static void find_loops(struct Cfg *cfg, const struct Predecessors *preds) {
+  cfg->loops = calloc(cfg->count, sizeof(struct Loop));
+  int *stack = malloc(cfg->count * sizeof(int));
+  assert(cfg->loops && stack);
+
+  for (size_t i = 0; i < cfg->count; i++) {
+    const struct Block *block = &cfg->blocks[i];
+    for (size_t j = 0; cfg->idom[i] != NO_BLOCK && j < block->target_count;
+         j++) {
+      int header = block->successors[j];
+      if (header == NO_BLOCK || !dominates(cfg, header, i))
+        continue;
+
+      struct Loop *loop = loop_at(cfg, header);
+      size_t depth = 0;
+      if (!is_member(loop, i)) {
+        add_member(loop, i);
+        stack[depth++] = i;
+      }
+      while (depth > 0) {
+        int member = stack[--depth];
+        for (size_t k = preds->start[member]; k < preds->start[member + 1];
+             k++) {
+          int pred = preds->preds[k];
+          if (!is_member(loop, pred)) {
+            add_member(loop, pred);
+            stack[depth++] = pred;
+          }
+        }
+      }
+    }
+  }
+  free(stack);
+
+  // the loops around a header, its own included
+  for (size_t i = 0; i < cfg->loop_count; i++) {
+    for (size_t j = 0; j < cfg->loop_count; j++)
+      cfg->loops[i].depth += is_member(&cfg->loops[j], cfg->loops[i].header);
+  }
+}
+
+static struct Cfg *build_cfg(const struct Function *function, uint8_t *code) {
+  struct Cfg *cfg = calloc(1, sizeof(struct Cfg));
+  assert(cfg);
+  cfg->function = *function;
+  cfg->code = code;
+
+  csh handle;
+  cs_insn *insns;
+  cs_open(CS_ARCH_X86, CS_MODE_64, &handle);
+  cs_option(handle, CS_OPT_DETAIL, CS_OPT_ON);
+  size_t count = cs_disasm(handle, code, function->end - function->start,
+                           function->start, 0, &insns);
+  if (count == 0) {
+    cs_close(&handle);
+    return cfg;
+  }
+  find_blocks(cfg, handle, insns, count);
+  cs_free(insns, count);
+  cs_close(&handle);
+
+  int *order = malloc(cfg->count * sizeof(int));
+  int *rank = malloc(cfg->count * sizeof(int));
+  assert(order && rank);
+  size_t reached = order_blocks(cfg, order, rank);
+
+  struct Predecessors preds;
+  find_predecessors(cfg, rank, &preds);
+  find_dominators(cfg, order, reached, rank, &preds);
+  find_loops(cfg, &preds);
+
+  free(preds.start);
+  free(preds.preds);
+  free(order);
+  free(rank);
+  return cfg;
+}
+
+static void free_cfg(struct Cfg *cfg) {
+  for (size_t i = 0; i < cfg->loop_count; i++)
+    free(cfg->loops[i].members);
+  free(cfg->loops);
+  free(cfg->idom);
+  free(cfg->blocks);
+  free(cfg->code);
+  free(cfg);
+}
+
+// the function's code gets read every time, patches and exec included, but
+// only decoded and analysed when it changed
+static struct Cfg *get_cfg(int pid, uint64_t address) {
+  struct Function function;
+  if (!find_function(pid, address, &function)) {
+    printf("? No function symbol around 0x%lx.\n", address);
+    return NULL;
+  }
+
+  size_t size = function.end - function.start;
+  if (size > MAX_FUNCTION_BYTES) {
+    printf("? %s is too big to graph.\n", function.name);
+    return NULL;
+  }
+  uint8_t *code = malloc(size);
+  assert(code);
+  if (read_memory(pid, function.start, code, size) != (ssize_t)size) {
+    printf("? Can't read %s.\n", function.name);
+    free(code);
+    return NULL;
+  }
+
+  struct Cfg **slot = NULL;
+  for (size_t i = 0; i < cache.count && !slot; i++) {
+    if (cache.cfgs[i]->function.start == function.start)
+      slot = &cache.cfgs[i];
+  }
+
+  if (slot && (*slot)->function.end == function.end &&
+      memcmp((*slot)->code, code, size) == 0) {
+    free(code);
+  } else if (slot) {
+    free_cfg(*slot);
+    *slot = build_cfg(&function, code);
+  } else {
+    if (cache.count == cache.capacity) {
+      cache.capacity = cache.capacity ? cache.capacity * 2 : 16;
+      cache.cfgs = realloc(cache.cfgs, cache.capacity * sizeof(struct Cfg *));
+      assert(cache.cfgs);
+    }
+    slot = &cache.cfgs[cache.count++];
+    *slot = build_cfg(&function, code);
+  }
+
+  if ((*slot)->count == 0) {
+    printf("? Can't decode %s.\n", function.name);
+    return NULL;
+  }
+  return *slot;
+}
+
+static void add_exit(uint64_t *exits, size_t *count, uint64_t address) {
+  for (size_t i = 0; i < *count && i < MAX_LOOP_EXITS; i++) {
+    if (exits[i] == address)
+      return;
+  }
+  if (*count < MAX_LOOP_EXITS)
+    exits[*count] = address;
+  (*count)++;
+}
+
+// edges to blocks outside the loop or outside the function, and the rets in
+// it. Indirect jumps are taken to stay inside, they mostly are switches
+static size_t collect_exits(const struct Cfg *cfg, const struct Loop *loop,
+                            uint64_t *exits) {
+  size_t count = 0;
+  for (size_t i = 0; i < cfg->count; i++) {
+    const struct Block *block = &cfg->blocks[i];
+    if (!is_member(loop, i))
+      continue;
+
+    for (size_t j = 0; j < block->target_count; j++) {
+      if (block->successors[j] == NO_BLOCK ||
+          !is_member(loop, block->successors[j]))
+        add_exit(exits, &count, block->targets[j]);
+    }
+    if (block->is_return)
+      add_exit(exits, &count, block->last);
+  }
+  return count;
+}
+
+// the innermost loop around the address, or the outermost. Returns how many
+// exits it has, though no more than MAX_LOOP_EXITS of them get stored
+size_t find_loop_exits(int pid, uint64_t address, bool is_outermost,
+                       uint64_t *exits) {
+  const struct Cfg *cfg = get_cfg(pid, address);
+  if (!cfg)
+    return 0;
+
+  int block = find_block(cfg, address);
+  const struct Loop *found = NULL;
+  for (size_t i = 0; block != NO_BLOCK && i < cfg->loop_count; i++) {
+    const struct Loop *loop = &cfg->loops[i];
+    if (is_member(loop, block) &&
+        (!found || (is_outermost ? loop->size > found->size
+                                 : loop->size < found->size)))
+      found = loop;
+  }
+  if (!found) {
+    printf("? 0x%lx isn't in a loop of %s.\n", address, cfg->function.name);
+    return 0;
+  }
+
+  size_t count = collect_exits(cfg, found, exits);
+  if (count == 0)
+    puts("? The loop never exits.");
+  return count;
+}
+
+static void print_block(const struct Cfg *cfg, int index, bool is_current) {
+  const struct Block *block = &cfg->blocks[index];
+  if (is_current)
+    printf(BOLD(GREEN("►  B%-4d 0x%lx")), index, block->start);
+  else
+    printf("   B%-4d " YELLOW("0x%lx"), index, block->start);
+  printf(" %4zu insns ", block->instructions);
+
+  for (size_t i = 0; i < block->target_count; i++) {
+    if (block->successors[i] != NO_BLOCK)
+      printf(" → B%d", block->successors[i]);
+    else
+      printf(" → 0x%lx", block->targets[i]);
+  }
+  if (block->is_return)
+    printf(" ret");
+  if (block->is_indirect)
+    printf(" → ?");
+  if (cfg->idom[index] == NO_BLOCK)
+    printf("  unreachable");
+  else if (index != 0)
+    printf("  idom B%d", cfg->idom[index]);
+  putchar('\n');
+}
+
+static void print_loop(const struct Cfg *cfg, const struct Loop *loop) {
+  printf("   loop B%d depth %zu:", loop->header, loop->depth);
+  for (size_t i = 0; i < cfg->count; i++) {
+    if (is_member(loop, i))
+      printf(" B%zu", i);
+  }
+
+  uint64_t exits[MAX_LOOP_EXITS];
+  size_t count = collect_exits(cfg, loop, exits);
+  printf(", %zu exits", count);
+  for (size_t i = 0; i < count && i < MAX_LOOP_EXITS; i++)
+    printf(" " YELLOW("0x%lx"), exits[i]);
+  putchar('\n');
+}
+
+void print_cfg(int pid, uint64_t address) {
+  const struct Cfg *cfg = get_cfg(pid, address);
+  if (!cfg)
+    return;
+
+  printf("%s " YELLOW("0x%lx-0x%lx") ", %zu blocks, %zu loops.\n",
+         cfg->function.name, cfg->function.start, cfg->function.end,
+         cfg->count, cfg->loop_count);
+  int current = find_block(cfg, address);
+  for (size_t i = 0; i < cfg->count; i++)
+    print_block(cfg, i, (int)i == current);
+  for (size_t i = 0; i < cfg->loop_count; i++)
+    print_loop(cfg, &cfg->loops[i]);
+}
+
+void free_cfgs(void) {
+  for (size_t i = 0; i < cache.count; i++)
+    free_cfg(cache.cfgs[i]);
+  free(cache.cfgs);
+  memset(&cache, 0, sizeof(cache));
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// more than there are debug registers, so a count past it still says why
+#define MAX_LOOP_EXITS 16
+
+void print_cfg(int pid, uint64_t address);
+size_t find_loop_exits(int pid, uint64_t address, bool is_outermost,
+                       uint64_t *exits);
+void free_cfgs(void);
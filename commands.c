@@ -1,95 +1,530 @@
 #include "commands.h"
+#include "assemble.h"
 #include "breakpoints.h"
+#include "cfg.h"
+#include "display.h"
+#include "eval.h"
+#include "heap.h"
+#include "journal.h"
+#include "lines.h"
+#include "maps.h"
+#include "memory.h"
+#include "parser.h"
+#include "render.h"
+#include "signals.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "stepping.h"
+#include "ui.h"
+#include "xstate.h"
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/ptrace.h>
 #include <sys/user.h>
 
-static enum ExecState cmd_stepinto(int pid, int64_t value) {
+static enum ExecState cmd_stepinto(int pid, int64_t value, char *args) {
+  (void)args;
   (void)value;
-  ptrace(PTRACE_SINGLESTEP, pid, 0, 0);
+  flush_journal(pid);
+  struct user_regs_struct regs;
+  PTRACE(PTRACE_GETREGS, pid, 0, &regs);
+
+  // stepping over a raw syscall bypasses the PTRACE_SYSCALL stops, and may
+  // well write to the terminal behind the view's back
+  uint16_t opcode = PTRACE(PTRACE_PEEKDATA, pid, regs.rip, 0);
+  if (opcode == 0x050f) {
+    invalidate_mappings();
+    frame_invalidate();
+  }
+
+  PTRACE(PTRACE_SINGLESTEP, pid, 0, take_signal());
   return CONTINUE_EXEC;
 }
 
-static enum ExecState cmd_go(int pid, int64_t value) {
+static enum ExecState cmd_go(int pid, int64_t value, char *args) {
+  (void)args;
   (void)value;
+  flush_journal(pid);
   apply_breakpoints(pid);
-  ptrace(PTRACE_SYSCALL, pid, 0, 0);
+  frame_invalidate();
+  PTRACE(PTRACE_SYSCALL, pid, 0, take_signal());
   return CONTINUE_EXEC;
 }
 
-static enum ExecState cmd_continue(int pid, int64_t value) {
+static enum ExecState cmd_continue(int pid, int64_t value, char *args) {
+  (void)args;
   (void)value;
+  flush_journal(pid);
   apply_breakpoints(pid);
-  ptrace(PTRACE_CONT, pid, 0, 0);
+  invalidate_mappings();
+  frame_invalidate();
+  PTRACE(PTRACE_CONT, pid, 0, take_signal());
   return CONTINUE_EXEC;
 }
 
-static enum ExecState cmd_quit(int pid, int64_t value) {
+static enum ExecState cmd_quit(int pid, int64_t value, char *args) {
+  (void)args;
   (void)value;
   (void)pid;
   return EXIT_EXEC;
 }
 
-static enum ExecState cmd_eval(int pid, int64_t value) {
+static enum ExecState cmd_step(int pid, int64_t value, char *args) {
+  (void)value;
+  (void)args;
+  flush_journal(pid);
+  if (!start_line_step(pid, STEP_INTO)) {
+    puts("? No line information here.");
+    return PAUSE_EXEC;
+  }
+  frame_invalidate();
+  return CONTINUE_EXEC;
+}
+
+static enum ExecState cmd_next(int pid, int64_t value, char *args) {
+  (void)value;
+  (void)args;
+  flush_journal(pid);
+  if (!start_line_step(pid, STEP_OVER)) {
+    puts("? No line information here.");
+    return PAUSE_EXEC;
+  }
+  frame_invalidate();
+  return CONTINUE_EXEC;
+}
+
+static enum ExecState cmd_interrupt(int pid, int64_t value, char *args) {
+  (void)args;
+  (void)pid;
+  (void)value;
+  return INTERRUPT_EXEC;
+}
+
+static enum ExecState cmd_eval(int pid, int64_t value, char *args) {
+  (void)args;
   (void)pid;
   printf("?: 0x%lx\n", value);
   return PAUSE_EXEC;
 }
 
-static enum ExecState cmd_examine(int pid, int64_t value) {
-  (void)pid;
-  uint64_t content_raw = ptrace(PTRACE_PEEKDATA, pid, value, 0);
-  uint8_t *content = (uint8_t *)&content_raw;
-  printf("x: 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n",
-         content[0], content[1], content[2], content[3], content[4], content[5],
-         content[6], content[7]);
+static enum ExecState cmd_examine(int pid, int64_t value, char *args) {
+  (void)args;
+  if (!find_mapping(pid, value)) {
+    puts("? Address not mapped.");
+    return PAUSE_EXEC;
+  }
+
+  // staged writes included. The mapping may end before the 8 bytes do
+  uint8_t content[8];
+  ssize_t got = read_memory(pid, value, content, sizeof(content));
+  if (got <= 0) {
+    puts("? Couldn't read memory.");
+    return PAUSE_EXEC;
+  }
+
+  printf("x:");
+  for (ssize_t i = 0; i < got; i++)
+    printf(" 0x%02x", content[i]);
+  putchar('\n');
+  if (got < (ssize_t)sizeof(content))
+    printf("? Only %zd bytes readable.\n", got);
 
   return PAUSE_EXEC;
 }
 
-static enum ExecState cmd_pid(int pid, int64_t value) {
+static enum ExecState cmd_pid(int pid, int64_t value, char *args) {
+  (void)args;
   (void)value;
   printf("%d\n", pid);
   return PAUSE_EXEC;
 }
 
-static enum ExecState cmd_break(int pid, int64_t value) {
+// an address expression, or file:line
+static enum ExecState cmd_break(int pid, int64_t value, char *args) {
+  char *colon = strrchr(args, ':');
+  if (colon) {
+    *colon = '\0';
+    uint64_t address;
+    if (!find_line_address(pid, args, strtoul(colon + 1, NULL, 10),
+                           &address)) {
+      printf("? No code for %s:%s.\n", args, colon + 1);
+      *colon = ':';
+      return PAUSE_EXEC;
+    }
+    *colon = ':';
+    value = address;
+  } else if (!eval_string(args, &value)) {
+    puts("missing argument.");
+    return PAUSE_EXEC;
+  }
+
   add_breakpoint(pid, value);
   return PAUSE_EXEC;
 }
 
-static enum ExecState cmd_remove_breakpoint(int pid, int64_t value) {
+static enum ExecState cmd_remove_breakpoint(int pid, int64_t value,
+                                            char *args) {
+  (void)args;
   remove_breakpoint(pid, value);
   return PAUSE_EXEC;
 }
 
-static enum ExecState cmd_list_breakpoints(int pid, int64_t value) {
+static enum ExecState cmd_list_breakpoints(int pid, int64_t value, char *args) {
+  (void)args;
   (void)value;
   list_breakpoints(pid);
   return PAUSE_EXEC;
 }
 
-static enum ExecState cmd_enable_breakpoint(int pid, int64_t value) {
+static enum ExecState cmd_enable_breakpoint(int pid, int64_t value,
+                                            char *args) {
+  (void)args;
   enable_breakpoint(pid, value);
   return PAUSE_EXEC;
 }
 
-static enum ExecState cmd_disable_breakpoint(int pid, int64_t value) {
+static enum ExecState cmd_disable_breakpoint(int pid, int64_t value,
+                                             char *args) {
+  (void)args;
   disable_breakpoint(pid, value);
   return PAUSE_EXEC;
 }
 
-struct Command commands[] = {{"s", cmd_stepinto, false},
-                             {"g", cmd_go, false},
-                             {"c", cmd_continue, false},
-                             {"q", cmd_quit, false},
-                             {"e", cmd_eval, true},
-                             {"x", cmd_examine, true},
-                             {"pid", cmd_pid, false},
-                             {"b", cmd_break, true},
-                             {"br", cmd_remove_breakpoint, true},
-                             {"bl", cmd_list_breakpoints, false},
-                             {"be", cmd_enable_breakpoint, true},
-                             {"bd", cmd_disable_breakpoint, true},
-                             {NULL, NULL, false}};
+static enum ExecState cmd_vmmap(int pid, int64_t value, char *args) {
+  (void)args;
+  (void)value;
+  // the cache only tracks a stopped tracee's syscalls
+  invalidate_mappings();
+  list_mappings(pid);
+  return PAUSE_EXEC;
+}
+
+static enum ExecState cmd_xregs(int pid, int64_t value, char *args) {
+  (void)args;
+  (void)pid;
+  (void)value;
+  toggle_xregs();
+  printf("extended registers %s.\n", xregs_shown() ? "shown" : "hidden");
+  return PAUSE_EXEC;
+}
+
+static enum ExecState cmd_stats(int pid, int64_t value, char *args) {
+  (void)args;
+  (void)pid;
+  (void)value;
+  print_stats();
+  return PAUSE_EXEC;
+}
+
+#define LIST_BEFORE 4
+#define LIST_AFTER 5
+
+// around the current line, or file:line
+static enum ExecState cmd_list(int pid, int64_t value, char *args) {
+  (void)value;
+  struct user_regs_struct regs;
+  PTRACE(PTRACE_GETREGS, pid, 0, &regs);
+
+  struct SourceLine current = {0};
+  bool has_current = find_line(pid, regs.rip, &current);
+
+  const char *file = current.file;
+  uint32_t line = current.line;
+
+  char *colon = strrchr(args, ':');
+  if (colon) {
+    *colon = '\0';
+    uint64_t address;
+    struct SourceLine found;
+    // resolved through the line table for the full path
+    if (find_line_address(pid, args, strtoul(colon + 1, NULL, 10),
+                          &address) &&
+        find_line(pid, address, &found)) {
+      file = found.file;
+      line = strtoul(colon + 1, NULL, 10);
+    } else {
+      file = NULL;
+    }
+    *colon = ':';
+  } else if (!has_current) {
+    file = NULL;
+  }
+
+  if (!file) {
+    puts("? No line information.");
+    return PAUSE_EXEC;
+  }
+
+  uint32_t first = line > LIST_BEFORE ? line - LIST_BEFORE : 1;
+  size_t len;
+  const char *text;
+  if (!get_source_text(file, first, &len)) {
+    printf("? Can't read %s.\n", file);
+    return PAUSE_EXEC;
+  }
+
+  for (uint32_t i = first;
+       i <= line + LIST_AFTER && (text = get_source_text(file, i, &len)); i++) {
+    bool is_current = has_current && i == current.line &&
+                      strcmp(file, current.file) == 0;
+    if (is_current)
+      printf(BOLD(GREEN("► %5u")) "  %.*s\n", i, (int)len, text);
+    else
+      printf("  %5u  %.*s\n", i, (int)len, text);
+  }
+
+  return PAUSE_EXEC;
+}
+
+static enum ExecState cmd_heaptrack(int pid, int64_t value, char *args) {
+  (void)value;
+  if (strcmp(args, "on") == 0)
+    start_heap_tracking(pid);
+  else if (strcmp(args, "off") == 0)
+    stop_heap_tracking(pid);
+  else
+    puts("? heaptrack on|off");
+  return PAUSE_EXEC;
+}
+
+// top, leaks, or find followed by an address expression
+static enum ExecState cmd_heap(int pid, int64_t value, char *args) {
+  if (strcmp(args, "top") == 0)
+    print_heap_top(pid);
+  else if (strcmp(args, "leaks") == 0)
+    print_heap_leaks(pid);
+  else if (strncmp(args, "find", 4) == 0 && eval_string(args + 4, &value))
+    print_heap_find(pid, value);
+  else
+    puts("? heap top|leaks|find address");
+  return PAUSE_EXEC;
+}
+
+static enum ExecState cmd_snapshot(int pid, int64_t value, char *args) {
+  (void)args;
+  (void)value;
+  take_snapshot(pid);
+  return PAUSE_EXEC;
+}
+
+static enum ExecState cmd_diff(int pid, int64_t value, char *args) {
+  (void)args;
+  (void)value;
+  diff_snapshot(pid);
+  return PAUSE_EXEC;
+}
+
+// $reg = expression, staged until the target resumes
+static enum ExecState cmd_set(int pid, int64_t value, char *args) {
+  (void)pid;
+  char *equals = strchr(args, '=');
+  if (!equals) {
+    puts("? set $reg = expression");
+    return PAUSE_EXEC;
+  }
+  *equals = '\0';
+
+  struct Node *node = parse_expression(args);
+  bool is_register = node && node->type == NODE_REGISTER;
+  enum Register reg = is_register ? node->value.as_register : 0;
+  if (node)
+    free_node(node);
+  *equals = '=';
+
+  if (!is_register || reg >= REGISTERS_COUNT) {
+    puts("? Only general purpose registers can be set.");
+    return PAUSE_EXEC;
+  }
+  if (!eval_string(equals + 1, &value)) {
+    puts("missing argument.");
+    return PAUSE_EXEC;
+  }
+
+  stage_register(reg, value);
+  return PAUSE_EXEC;
+}
+
+#define MAX_WRITE_LENGTH 256
+
+// an address expression, then the bytes
+static enum ExecState cmd_write(int pid, int64_t value, char *args) {
+  char *bytes = args + strcspn(args, " \t");
+  char separator = *bytes;
+  *bytes = '\0';
+  bool is_valid = eval_string(args, &value);
+  // an empty line repeats the command as it was typed
+  *bytes = separator;
+
+  if (!is_valid) {
+    puts("? write address bytes...");
+    return PAUSE_EXEC;
+  }
+
+  uint8_t buffer[MAX_WRITE_LENGTH];
+  size_t length = 0;
+  while (true) {
+    char *end;
+    unsigned long byte = strtoul(bytes, &end, 16);
+    if (end == bytes)
+      break;
+    if (byte > 0xff || length == MAX_WRITE_LENGTH) {
+      puts("? Bytes are 00 to ff, at most 256 of them.");
+      return PAUSE_EXEC;
+    }
+    buffer[length++] = byte;
+    bytes = end;
+  }
+
+  if (length == 0)
+    puts("? write address bytes...");
+  else if (!stage_memory(pid, value, buffer, length))
+    puts("? Address not mapped.");
+  return PAUSE_EXEC;
+}
+
+// an address expression, then the instructions in quotes
+static enum ExecState cmd_patch(int pid, int64_t value, char *args) {
+  // assemble() cuts up the instructions too, an empty line repeats the
+  // command as it was typed
+  char line[strlen(args) + 1];
+  args = strcpy(line, args);
+
+  char *source = strchr(args, '"');
+  char *close = source ? strrchr(source + 1, '"') : NULL;
+  if (!close) {
+    puts("? patch address \"instructions\"");
+    return PAUSE_EXEC;
+  }
+  *source++ = '\0';
+  *close = '\0';
+
+  if (!eval_string(args, &value)) {
+    puts("missing argument.");
+    return PAUSE_EXEC;
+  }
+
+  uint8_t code[MAX_PATCH_LENGTH];
+  size_t length = assemble(source, value, code);
+  if (length == 0)
+    return PAUSE_EXEC;
+
+  if (!stage_memory(pid, value, code, length))
+    puts("? Address not mapped.");
+  else
+    printf("%zu bytes at 0x%lx.\n", length, value);
+  return PAUSE_EXEC;
+}
+
+static enum ExecState cmd_undo(int pid, int64_t value, char *args) {
+  (void)args;
+  (void)value;
+  if (!undo_journal(pid))
+    puts("? Nothing to undo.");
+  return PAUSE_EXEC;
+}
+
+static enum ExecState cmd_handle(int pid, int64_t value, char *args) {
+  (void)pid;
+  (void)value;
+  handle_signal(args);
+  return PAUSE_EXEC;
+}
+
+static enum ExecState cmd_signal(int pid, int64_t value, char *args) {
+  (void)pid;
+  (void)value;
+  replace_signal(args);
+  return PAUSE_EXEC;
+}
+
+// the function around rip, or around an address expression
+static enum ExecState cmd_cfg(int pid, int64_t value, char *args) {
+  if (*args == '\0') {
+    struct user_regs_struct regs;
+    PTRACE(PTRACE_GETREGS, pid, 0, &regs);
+    value = regs.rip;
+  } else if (!eval_string(args, &value)) {
+    puts("? cfg [address]");
+    return PAUSE_EXEC;
+  }
+  print_cfg(pid, value);
+  return PAUSE_EXEC;
+}
+
+// until leaves the innermost loop around rip, advance all of them
+static enum ExecState leave_loop(int pid, bool is_outermost) {
+  flush_journal(pid);
+  if (!start_loop_exit(pid, is_outermost))
+    return PAUSE_EXEC;
+  invalidate_mappings();
+  frame_invalidate();
+  return CONTINUE_EXEC;
+}
+
+static enum ExecState cmd_until(int pid, int64_t value, char *args) {
+  (void)args;
+  (void)value;
+  return leave_loop(pid, false);
+}
+
+static enum ExecState cmd_advance(int pid, int64_t value, char *args) {
+  (void)args;
+  (void)value;
+  return leave_loop(pid, true);
+}
+
+// with an expression adds it to the pane, without lists them
+static enum ExecState cmd_display(int pid, int64_t value, char *args) {
+  (void)value;
+  if (*args == '\0')
+    list_displays(pid);
+  else
+    add_display(args);
+  return PAUSE_EXEC;
+}
+
+static enum ExecState cmd_undisplay(int pid, int64_t value, char *args) {
+  (void)pid;
+  (void)args;
+  if (!remove_display(value))
+    puts("? No such display.");
+  return PAUSE_EXEC;
+}
+
+struct Command commands[] = {{"s", cmd_stepinto, false, WHEN_STOPPED},
+                             {"g", cmd_go, false, WHEN_STOPPED},
+                             {"c", cmd_continue, false, WHEN_STOPPED},
+                             {"q", cmd_quit, false, WHEN_EITHER},
+                             {"interrupt", cmd_interrupt, false, WHEN_RUNNING},
+                             {"e", cmd_eval, true, WHEN_STOPPED},
+                             {"x", cmd_examine, true, WHEN_STOPPED},
+                             {"pid", cmd_pid, false, WHEN_EITHER},
+                             {"b", cmd_break, false, WHEN_STOPPED},
+                             {"br", cmd_remove_breakpoint, true, WHEN_STOPPED},
+                             {"bl", cmd_list_breakpoints, false, WHEN_EITHER},
+                             {"be", cmd_enable_breakpoint, true, WHEN_STOPPED},
+                             {"bd", cmd_disable_breakpoint, true, WHEN_STOPPED},
+                             {"vmmap", cmd_vmmap, false, WHEN_EITHER},
+                             {"xregs", cmd_xregs, false, WHEN_STOPPED},
+                             {"stats", cmd_stats, false, WHEN_EITHER},
+                             {"step", cmd_step, false, WHEN_STOPPED},
+                             {"next", cmd_next, false, WHEN_STOPPED},
+                             {"list", cmd_list, false, WHEN_STOPPED},
+                             {"heap", cmd_heap, false, WHEN_EITHER},
+                             {"heaptrack", cmd_heaptrack, false, WHEN_STOPPED},
+                             {"snapshot", cmd_snapshot, false, WHEN_STOPPED},
+                             {"diff", cmd_diff, false, WHEN_STOPPED},
+                             {"set", cmd_set, false, WHEN_STOPPED},
+                             {"write", cmd_write, false, WHEN_STOPPED},
+                             {"patch", cmd_patch, false, WHEN_STOPPED},
+                             {"undo", cmd_undo, false, WHEN_STOPPED},
+                             {"handle", cmd_handle, false, WHEN_EITHER},
+                             {"signal", cmd_signal, false, WHEN_STOPPED},
+                             {"cfg", cmd_cfg, false, WHEN_STOPPED},
+                             {"until", cmd_until, false, WHEN_STOPPED},
+                             {"advance", cmd_advance, false, WHEN_STOPPED},
+                             {"display", cmd_display, false, WHEN_STOPPED},
+                             {"undisplay", cmd_undisplay, true, WHEN_STOPPED},
+                             {NULL, NULL, false, WHEN_STOPPED}};
@@ -3,18 +3,29 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-enum ExecState : uint8_t { CONTINUE_EXEC, PAUSE_EXEC, EXIT_EXEC };
+enum ExecState : uint8_t {
+  CONTINUE_EXEC,
+  PAUSE_EXEC,
+  EXIT_EXEC,
+  INTERRUPT_EXEC
+};
+
+// most commands need the target stopped
+enum RunsWhen : uint8_t { WHEN_STOPPED = 0, WHEN_RUNNING, WHEN_EITHER };
 
-// TODO: args should probably be variadic
-typedef enum ExecState (*cmd_handler_t)(int pid, int64_t value);
+// value is the evaluated argument of takes_arg commands, args the raw text
+// after the command name
+typedef enum ExecState (*cmd_handler_t)(int pid, int64_t value, char *args);
 
 struct Command {
   const char *alias;
   cmd_handler_t handler;
   bool takes_arg;
+  enum RunsWhen runs_when;
 };
 
 struct CommandInstance {
   struct Command *cmd;
   struct Node *arg;
+  char *args;
 };
@@ -1,11 +1,15 @@
 #include "disassembler.h"
 #include "breakpoints.h"
+#include "lines.h"
+#include "render.h"
 #include "ui.h"
 #include <capstone/capstone.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/ptrace.h>
 
 extern struct Breakpoint *breakpoints;
+extern int pid;
 
 void disassemble(uint8_t *bytes, uint64_t pc) {
   csh handle;
@@ -18,19 +22,38 @@ void disassemble(uint8_t *bytes, uint64_t pc) {
                     pc, 0, &insn);
   if (count > 0) {
     size_t j;
-    for (j = 0; j < DISASSEMBLY_LINES; j++) {
+    size_t lines = 0;
+    struct SourceLine prev_line = {0};
+
+    for (j = 0; j < count && lines < DISASSEMBLY_LINES; j++, lines++) {
+      // source lines take their share of the pane
+      struct SourceLine line;
+      if (find_line(pid, insn[j].address, &line) &&
+          line.address == insn[j].address && line.is_stmt &&
+          (line.line != prev_line.line || line.file != prev_line.file)) {
+        const char *name = strrchr(line.file, '/');
+        size_t len = 0;
+        const char *text = get_source_text(line.file, line.line, &len);
+        frame_printf("   " YELLOW("%s:%u") "\t%.*s\n",
+                     name ? name + 1 : line.file, line.line, (int)len,
+                     text ? text : "");
+        prev_line = line;
+        if (++lines == DISASSEMBLY_LINES)
+          break;
+      }
+
       if (insn[j].address == pc) {
-        printf(BOLD(GREEN("►  0x%" PRIx64 "\t%s")) "\t\t" BLUE("%s") "\n",
-               insn[j].address, insn[j].mnemonic, insn[j].op_str);
+        frame_printf(BOLD(GREEN("►  0x%" PRIx64 "\t%s")) "\t\t" BLUE("%s") "\n",
+                     insn[j].address, insn[j].mnemonic, insn[j].op_str);
       } else {
-        printf("   0x%" PRIx64 "\t" GREEN("%s") "\t\t" BLUE("%s") "\n",
-               insn[j].address, insn[j].mnemonic, insn[j].op_str);
+        frame_printf("   0x%" PRIx64 "\t" GREEN("%s") "\t\t" BLUE("%s") "\n",
+                     insn[j].address, insn[j].mnemonic, insn[j].op_str);
       }
     }
 
     cs_free(insn, count);
   } else
-    printf("ERROR: Failed to disassemble given code!\n");
+    frame_printf("ERROR: Failed to disassemble given code!\n");
 
   cs_close(&handle);
 }
@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+#include "display.h"
+#include "eval.h"
+#include "journal.h"
+#include "parser.h"
+#include "render.h"
+#include "stats.h"
+#include "ui.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+
+extern struct user_regs_struct regs;
+
+struct Display {
+  char *source;
+  struct Node *node;
+  int64_t value;
+  // what the value came from, it holds until one of these changes
+  struct Inputs inputs;
+  bool is_cached;
+  bool is_changed;
+};
+
+static struct {
+  struct Display *displays;
+  size_t count;
+  size_t capacity;
+  // the registers as of the last refresh, to diff the next stop against
+  struct user_regs_struct regs;
+} display;
+
+static void evaluate(struct Display *entry) {
+  int64_t old = entry->value;
+  bool was_faulted = entry->inputs.is_faulted;
+
+  memset(&entry->inputs, 0, sizeof(entry->inputs));
+  entry->value = eval_inputs(entry->node, &regs, &entry->inputs);
+  entry->is_changed = entry->is_cached && (entry->value != old ||
+                                           entry->inputs.is_faulted !=
+                                               was_faulted);
+}
+
+static void print_display(size_t index) {
+  const struct Display *entry = &display.displays[index];
+  if (entry->inputs.is_divided_by_zero)
+    printf("#%zu  %s = division by zero\n", index, entry->source);
+  else if (entry->inputs.is_faulted)
+    printf("#%zu  %s = unreadable\n", index, entry->source);
+  else
+    printf("#%zu  %s = 0x%lx\n", index, entry->source, entry->value);
+}
+
+static struct Display *append_display(char *source) {
+  struct Node *node = parse_expression(source);
+  if (!node)
+    return NULL;
+
+  if (display.count == display.capacity) {
+    display.capacity = display.capacity ? display.capacity * 2 : 8;
+    display.displays =
+        realloc(display.displays, display.capacity * sizeof(struct Display));
+    assert(display.displays);
+  }
+
+  struct Display *entry = &display.displays[display.count++];
+  memset(entry, 0, sizeof(*entry));
+  entry->source = strdup(source);
+  entry->node = node;
+  return entry;
+}
+
+void add_display(char *source) {
+  struct Display *entry = append_display(source);
+  if (!entry) {
+    puts("? display expression");
+    return;
+  }
+
+  evaluate(entry);
+  // staged registers went into this one, the next stop evaluates it again
+  entry->is_cached = false;
+
+  print_display(display.count - 1);
+}
+
+bool remove_display(size_t index) {
+  if (index >= display.count)
+    return false;
+
+  free(display.displays[index].source);
+  free_node(display.displays[index].node);
+  memmove(&display.displays[index], &display.displays[index + 1],
+          (display.count - index - 1) * sizeof(struct Display));
+  display.count--;
+  return true;
+}
+
+bool has_displays(void) { return display.count > 0; }
+
+// the sources back to back, each with its NUL, for the session file
+char *save_displays(size_t *size) {
+  *size = 0;
+  for (size_t i = 0; i < display.count; i++)
+    *size += strlen(display.displays[i].source) + 1;
+
+  char *saved = malloc(*size ? *size : 1);
+  assert(saved);
+  char *at = saved;
+  for (size_t i = 0; i < display.count; i++)
+    at = stpcpy(at, display.displays[i].source) + 1;
+  return saved;
+}
+
+// not evaluated until the next stop refreshes them
+void restore_displays(const char *saved, size_t size) {
+  const char *end = saved + size;
+  for (const char *at = saved; at < end;) {
+    const char *nul = memchr(at, '\0', end - at);
+    if (!nul)
+      break;
+
+    char *source = strdup(at);
+    append_display(source);
+    free(source);
+    at = nul + 1;
+  }
+}
+
+static uint32_t changed_registers(void) {
+  uint32_t changed = 0;
+  for (size_t i = 0; i < REGISTERS_COUNT; i++) {
+    if (((uint64_t *)&regs)[i] != ((uint64_t *)&display.regs)[i])
+      changed |= 1u << i;
+  }
+  return changed;
+}
+
+// every cached read again in a single process_vm_readv, a value is only
+// stale when its registers or the quadwords it read changed
+static void refresh_displays(int pid) {
+  uint32_t changed = changed_registers();
+
+  size_t total = 0;
+  for (size_t i = 0; i < display.count; i++) {
+    if (display.displays[i].is_cached)
+      total += display.displays[i].inputs.reads_count;
+  }
+
+  uint64_t now[total ? total : 1];
+  struct iovec local[total ? total : 1], remote[total ? total : 1];
+  size_t at = 0;
+  for (size_t i = 0; i < display.count; i++) {
+    const struct Display *entry = &display.displays[i];
+    for (size_t j = 0; entry->is_cached && j < entry->inputs.reads_count;
+         j++, at++) {
+      local[at] = (struct iovec){&now[at], sizeof(uint64_t)};
+      remote[at] = (struct iovec){(void *)entry->inputs.reads[j],
+                                  sizeof(uint64_t)};
+    }
+  }
+
+  ssize_t got = 0;
+  if (total > 0 && total <= IOV_MAX) {
+    got = process_vm_readv(pid, local, total, remote, total, 0);
+    if (got > 0)
+      note_memory_read(got);
+    for (size_t i = 0; got > 0 && i < total; i++)
+      overlay_staged((uint64_t)remote[i].iov_base, now + i,
+                     sizeof(uint64_t));
+  }
+  size_t read = got > 0 ? got / sizeof(uint64_t) : 0;
+
+  at = 0;
+  for (size_t i = 0; i < display.count; i++) {
+    struct Display *entry = &display.displays[i];
+    bool is_stale = !entry->is_cached || entry->inputs.is_uncacheable ||
+                    (entry->inputs.registers & changed);
+    for (size_t j = 0; entry->is_cached && j < entry->inputs.reads_count;
+         j++, at++) {
+      is_stale |= at >= read || now[at] != entry->inputs.values[j];
+    }
+
+    if (is_stale) {
+      evaluate(entry);
+      entry->is_cached = true;
+    } else {
+      entry->is_changed = false;
+    }
+  }
+
+  display.regs = regs;
+}
+
+void draw_displays(int pid) {
+  refresh_displays(pid);
+
+  for (size_t i = 0; i < display.count; i++) {
+    const struct Display *entry = &display.displays[i];
+    frame_printf("   " BOLD("#%zu") "  %s = ", i, entry->source);
+    if (entry->inputs.is_divided_by_zero)
+      frame_printf(RED("division by zero") "\n");
+    else if (entry->inputs.is_faulted)
+      frame_printf(RED("unreadable") "\n");
+    else if (entry->is_changed)
+      frame_printf(RED("0x%lx") "\n", entry->value);
+    else
+      frame_printf("0x%lx\n", entry->value);
+  }
+}
+
+// scripts draw no view, so this refreshes too
+void list_displays(int pid) {
+  refresh_displays(pid);
+  for (size_t i = 0; i < display.count; i++)
+    print_display(i);
+}
+
+void free_displays(void) {
+  for (size_t i = 0; i < display.count; i++) {
+    free(display.displays[i].source);
+    free_node(display.displays[i].node);
+  }
+  free(display.displays);
+  memset(&display, 0, sizeof(display));
+}
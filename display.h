@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void add_display(char *source);
+bool remove_display(size_t index);
+bool has_displays(void);
+char *save_displays(size_t *size);
+void restore_displays(const char *saved, size_t size);
+void list_displays(int pid);
+void draw_displays(int pid);
+void free_displays(void);
@@ -1,38 +1,110 @@
+#include "eval.h"
+#include "memory.h"
 #include "parser.h"
-#include <assert.h>
+#include "xstate.h"
+#include <stdint.h>
+#include <stdio.h>
 
-int64_t eval(struct Node *node, struct user_regs_struct *regs) {
+extern int pid;
+extern struct user_regs_struct regs;
+
+// unreadable memory reads as 0
+static int64_t deref(uint64_t address, struct Inputs *inputs) {
+  uint64_t value = 0;
+  bool is_read =
+      read_memory(pid, address, &value, sizeof(value)) == sizeof(value);
+  if (!inputs)
+    return is_read ? value : 0;
+
+  if (!is_read) {
+    inputs->is_faulted = true;
+    inputs->is_uncacheable = true;
+    return 0;
+  }
+  if (inputs->reads_count == MAX_INPUT_READS) {
+    inputs->is_uncacheable = true;
+    return value;
+  }
+  inputs->reads[inputs->reads_count] = address;
+  inputs->values[inputs->reads_count++] = value;
+  return value;
+}
+
+// inputs, when given, collects everything the value depends on
+int64_t eval_inputs(struct Node *node, struct user_regs_struct *regs,
+                    struct Inputs *inputs) {
 
   if (node->type == NODE_NUMBER) {
     return node->value.as_number;
   }
 
   if (node->type == NODE_REGISTER) {
+    if (node->value.as_register >= REGISTERS_COUNT) {
+      if (inputs)
+        inputs->is_uncacheable = true;
+      return get_xreg(pid, node->value.as_register);
+    }
+    if (inputs)
+      inputs->registers |= 1u << node->value.as_register;
     return *((uint64_t *)regs + node->value.as_register);
   }
 
+  if (node->type == NODE_DEREF) {
+    return deref(eval_inputs(node->value.as_operand, regs, inputs), inputs);
+  }
+
   if (node->type == NODE_ADD) {
-    return eval(node->value.as_bi_op.lhs, regs) +
-           eval(node->value.as_bi_op.rhs, regs);
+    return eval_inputs(node->value.as_bi_op.lhs, regs, inputs) +
+           eval_inputs(node->value.as_bi_op.rhs, regs, inputs);
   }
 
   if (node->type == NODE_SUB) {
-    return eval(node->value.as_bi_op.lhs, regs) -
-           eval(node->value.as_bi_op.rhs, regs);
+    return eval_inputs(node->value.as_bi_op.lhs, regs, inputs) -
+           eval_inputs(node->value.as_bi_op.rhs, regs, inputs);
   }
 
   if (node->type == NODE_MUL) {
-    return eval(node->value.as_bi_op.lhs, regs) *
-           eval(node->value.as_bi_op.rhs, regs);
+    return eval_inputs(node->value.as_bi_op.lhs, regs, inputs) *
+           eval_inputs(node->value.as_bi_op.rhs, regs, inputs);
   }
 
+  // the divisor may come out of tracee memory, anything goes
   if (node->type == NODE_DIV) {
-    int64_t rhs = eval(node->value.as_bi_op.rhs, regs);
-
-    assert(rhs != 0);
+    int64_t rhs = eval_inputs(node->value.as_bi_op.rhs, regs, inputs);
+    int64_t lhs = eval_inputs(node->value.as_bi_op.lhs, regs, inputs);
 
-    return eval(node->value.as_bi_op.lhs, regs) / rhs;
+    if (rhs == 0) {
+      if (inputs) {
+        inputs->is_faulted = true;
+        inputs->is_divided_by_zero = true;
+      }
+      return 0;
+    }
+    // the one quotient that doesn't fit would SIGFPE us, it wraps instead
+    if (lhs == INT64_MIN && rhs == -1)
+      return INT64_MIN;
+    return lhs / rhs;
   }
 
   return -1;
 }
+
+// unreadable memory reads as 0, only a division by 0 fails
+bool eval(struct Node *node, struct user_regs_struct *regs, int64_t *value) {
+  struct Inputs inputs = {0};
+  *value = eval_inputs(node, regs, &inputs);
+  if (inputs.is_divided_by_zero)
+    puts("? Division by zero.");
+  return !inputs.is_divided_by_zero;
+}
+
+// for commands that take more than a single expression
+bool eval_string(char *source, int64_t *value) {
+  struct Node *node = parse_expression(source);
+  if (!node)
+    return false;
+
+  bool is_valid = eval(node, &regs, value);
+  free_node(node);
+  return is_valid;
+}
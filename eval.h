@@ -1,6 +1,29 @@
 #pragma once
 #include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/user.h>
 
-int64_t eval(struct Node *node, struct user_regs_struct *regs);
+#define MAX_INPUT_READS 16
+
+// what an evaluation read, nothing else can change its value
+struct Inputs {
+  // a bit per general purpose register
+  uint32_t registers;
+  // the quadwords dereferenced and what they held
+  uint64_t reads[MAX_INPUT_READS];
+  uint64_t values[MAX_INPUT_READS];
+  size_t reads_count;
+  // vector registers, too many reads or a read that failed, so it can't be
+  // told whether the value is still good
+  bool is_uncacheable;
+  bool is_faulted;
+  // faulted too, but for a divisor of 0 rather than a read
+  bool is_divided_by_zero;
+};
+
+bool eval(struct Node *node, struct user_regs_struct *regs, int64_t *value);
+int64_t eval_inputs(struct Node *node, struct user_regs_struct *regs,
+                    struct Inputs *inputs);
+bool eval_string(char *source, int64_t *value);
@@ -0,0 +1,122 @@
+#include "events.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define MAX_WATCHES 16
+#define MAX_EVENTS 8
+
+struct Watch {
+  int fd;
+  event_handler_t handler;
+  void *data;
+  bool is_timer;
+};
+
+static struct Watch watches[MAX_WATCHES];
+static int epoll_fd = -1;
+
+static struct Watch *find_watch(int fd) {
+  for (size_t i = 0; i < MAX_WATCHES; i++) {
+    if (watches[i].handler && watches[i].fd == fd)
+      return &watches[i];
+  }
+  return NULL;
+}
+
+// fails for fds epoll can't wait on, like regular files
+static bool add_watch(int fd, event_handler_t handler, void *data,
+                      bool is_timer) {
+  if (epoll_fd == -1) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    assert(epoll_fd != -1);
+  }
+
+  struct Watch *watch = NULL;
+  for (size_t i = 0; !watch && i < MAX_WATCHES; i++) {
+    if (!watches[i].handler)
+      watch = &watches[i];
+  }
+  assert(watch);
+
+  struct epoll_event event = {.events = EPOLLIN, .data.ptr = watch};
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+    return false;
+
+  *watch = (struct Watch){fd, handler, data, is_timer};
+  return true;
+}
+
+bool watch_fd(int fd, event_handler_t handler, void *data) {
+  return add_watch(fd, handler, data, false);
+}
+
+void unwatch_fd(int fd) {
+  struct Watch *watch = find_watch(fd);
+  if (!watch)
+    return;
+
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  watch->handler = NULL;
+}
+
+// one-shot, returns an id for cancel_timer
+int add_timer(uint64_t ms, event_handler_t handler, void *data) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  assert(fd != -1);
+
+  struct itimerspec spec = {
+      .it_value = {.tv_sec = ms / 1000, .tv_nsec = ms % 1000 * 1000000},
+  };
+  timerfd_settime(fd, 0, &spec, NULL);
+
+  bool is_added = add_watch(fd, handler, data, true);
+  assert(is_added);
+  return fd;
+}
+
+void cancel_timer(int fd) {
+  if (!find_watch(fd))
+    return;
+
+  unwatch_fd(fd);
+  close(fd);
+}
+
+// waits for at least one event and runs the handlers of everything ready
+void poll_events(void) {
+  struct epoll_event events[MAX_EVENTS];
+
+  int count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+  for (int i = 0; i < count; i++) {
+    struct Watch *watch = events[i].data.ptr;
+    // an earlier handler in this batch may have dropped it
+    if (!watch->handler)
+      continue;
+
+    struct Watch fired = *watch;
+    if (fired.is_timer)
+      cancel_timer(fired.fd);
+
+    fired.handler(fired.fd, fired.data);
+  }
+}
+
+void free_events(void) {
+  for (size_t i = 0; i < MAX_WATCHES; i++) {
+    if (!watches[i].handler)
+      continue;
+    if (watches[i].is_timer)
+      close(watches[i].fd);
+    watches[i].handler = NULL;
+  }
+
+  if (epoll_fd != -1) {
+    close(epoll_fd);
+    epoll_fd = -1;
+  }
+}
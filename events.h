@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*event_handler_t)(int fd, void *data);
+
+bool watch_fd(int fd, event_handler_t handler, void *data);
+void unwatch_fd(int fd);
+int add_timer(uint64_t ms, event_handler_t handler, void *data);
+void cancel_timer(int fd);
+void poll_events(void);
+void free_events(void);
@@ -0,0 +1,951 @@
+#include "gdbserver.h"
+#include "breakpoints.h"
+#include "maps.h"
+#include "memory.h"
+#include "stats.h"
+#include "xstate.h"
+#include <assert.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PACKET_SIZE 0x4000
+#define INTERRUPT_CHAR 0x03
+
+extern int pid;
+extern struct user_regs_struct regs;
+extern void run_tracee(char *argv[]);
+extern bool start_tracee(int tracee, int *stop_status);
+
+static int client_fd = -1;
+static bool no_ack = false;
+static int stop_status;
+// the debug register slot behind the last SIGTRAP, -1 for none
+static int hit_id = -1;
+static bool is_detached = false;
+
+// what each slot was asked for with, Z3 and Z4 share BP_ACCESS
+static struct {
+  char type;
+  uint64_t address;
+} points[MAX_BREAKPOINTS];
+static sigset_t wait_mask;
+
+static char input[PACKET_SIZE];
+static size_t input_len = 0, input_pos = 0;
+
+static char packet[PACKET_SIZE];
+static char reply[PACKET_SIZE * 2 + 8];
+
+// GDB has its own signal numbering, these are the ones that differ on Linux
+static const struct {
+  int host;
+  int gdb;
+} signal_map[] = {
+    {SIGBUS, 10},   {SIGUSR1, 30},  {SIGUSR2, 31},  {SIGCHLD, 20},
+    {SIGCONT, 19},  {SIGSTOP, 17},  {SIGTSTP, 18},  {SIGTTIN, 21},
+    {SIGTTOU, 22},  {SIGURG, 16},   {SIGXCPU, 24},  {SIGXFSZ, 25},
+    {SIGVTALRM, 26}, {SIGPROF, 27}, {SIGWINCH, 28}, {SIGIO, 23},
+    {SIGPWR, 32},   {SIGSYS, 12},
+};
+
+static int to_gdb_signal(int sig) {
+  for (size_t i = 0; i < sizeof(signal_map) / sizeof(signal_map[0]); i++) {
+    if (signal_map[i].host == sig)
+      return signal_map[i].gdb;
+  }
+  return sig;
+}
+
+static int from_gdb_signal(int sig) {
+  for (size_t i = 0; i < sizeof(signal_map) / sizeof(signal_map[0]); i++) {
+    if (signal_map[i].gdb == sig)
+      return signal_map[i].host;
+  }
+  return sig;
+}
+
+// register layout, in the order target.xml numbers them
+enum RegFormat : uint8_t { REG_GPR, REG_FXSAVE, REG_FXSAVE16, REG_FTAG };
+
+static const struct {
+  enum RegFormat format;
+  size_t offset;
+  uint8_t size;
+} gdb_registers[] = {
+#define GPR(name, size) {REG_GPR, offsetof(struct user_regs_struct, name), size}
+    GPR(rax, 8),     GPR(rbx, 8),    GPR(rcx, 8),    GPR(rdx, 8),
+    GPR(rsi, 8),     GPR(rdi, 8),    GPR(rbp, 8),    GPR(rsp, 8),
+    GPR(r8, 8),      GPR(r9, 8),     GPR(r10, 8),    GPR(r11, 8),
+    GPR(r12, 8),     GPR(r13, 8),    GPR(r14, 8),    GPR(r15, 8),
+    GPR(rip, 8),     GPR(eflags, 4), GPR(cs, 4),     GPR(ss, 4),
+    GPR(ds, 4),      GPR(es, 4),     GPR(fs, 4),     GPR(gs, 4),
+    {REG_FXSAVE, 32, 10},  {REG_FXSAVE, 48, 10},  {REG_FXSAVE, 64, 10},
+    {REG_FXSAVE, 80, 10},  {REG_FXSAVE, 96, 10},  {REG_FXSAVE, 112, 10},
+    {REG_FXSAVE, 128, 10}, {REG_FXSAVE, 144, 10},
+    {REG_FXSAVE16, 0, 4},  {REG_FXSAVE16, 2, 4},  {REG_FTAG, 4, 4},
+    {REG_FXSAVE16, 12, 4}, {REG_FXSAVE, 8, 4},    {REG_FXSAVE16, 20, 4},
+    {REG_FXSAVE, 16, 4},   {REG_FXSAVE16, 6, 4},
+    {REG_FXSAVE, 160, 16}, {REG_FXSAVE, 176, 16}, {REG_FXSAVE, 192, 16},
+    {REG_FXSAVE, 208, 16}, {REG_FXSAVE, 224, 16}, {REG_FXSAVE, 240, 16},
+    {REG_FXSAVE, 256, 16}, {REG_FXSAVE, 272, 16}, {REG_FXSAVE, 288, 16},
+    {REG_FXSAVE, 304, 16}, {REG_FXSAVE, 320, 16}, {REG_FXSAVE, 336, 16},
+    {REG_FXSAVE, 352, 16}, {REG_FXSAVE, 368, 16}, {REG_FXSAVE, 384, 16},
+    {REG_FXSAVE, 400, 16},
+    {REG_FXSAVE, 24, 4},
+    GPR(orig_rax, 8), GPR(fs_base, 8), GPR(gs_base, 8),
+#undef GPR
+};
+
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target><architecture>i386:x86-64</architecture><osabi>GNU/Linux</osabi>"
+    "<feature name=\"org.gnu.gdb.i386.core\">"
+    "<flags id=\"i386_eflags\" size=\"4\">"
+    "<field name=\"CF\" start=\"0\" end=\"0\"/>"
+    "<field name=\"PF\" start=\"2\" end=\"2\"/>"
+    "<field name=\"AF\" start=\"4\" end=\"4\"/>"
+    "<field name=\"ZF\" start=\"6\" end=\"6\"/>"
+    "<field name=\"SF\" start=\"7\" end=\"7\"/>"
+    "<field name=\"TF\" start=\"8\" end=\"8\"/>"
+    "<field name=\"IF\" start=\"9\" end=\"9\"/>"
+    "<field name=\"DF\" start=\"10\" end=\"10\"/>"
+    "<field name=\"OF\" start=\"11\" end=\"11\"/>"
+    "</flags>"
+    "<reg name=\"rax\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"rbx\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"rcx\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"rdx\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"rsi\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"rdi\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"rbp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"rsp\" bitsize=\"64\" type=\"data_ptr\"/>"
+    "<reg name=\"r8\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"r9\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"r10\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"r11\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"r12\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"r13\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"r14\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"r15\" bitsize=\"64\" type=\"int64\"/>"
+    "<reg name=\"rip\" bitsize=\"64\" type=\"code_ptr\"/>"
+    "<reg name=\"eflags\" bitsize=\"32\" type=\"i386_eflags\"/>"
+    "<reg name=\"cs\" bitsize=\"32\" type=\"int32\"/>"
+    "<reg name=\"ss\" bitsize=\"32\" type=\"int32\"/>"
+    "<reg name=\"ds\" bitsize=\"32\" type=\"int32\"/>"
+    "<reg name=\"es\" bitsize=\"32\" type=\"int32\"/>"
+    "<reg name=\"fs\" bitsize=\"32\" type=\"int32\"/>"
+    "<reg name=\"gs\" bitsize=\"32\" type=\"int32\"/>"
+    "<reg name=\"st0\" bitsize=\"80\" type=\"i387_ext\"/>"
+    "<reg name=\"st1\" bitsize=\"80\" type=\"i387_ext\"/>"
+    "<reg name=\"st2\" bitsize=\"80\" type=\"i387_ext\"/>"
+    "<reg name=\"st3\" bitsize=\"80\" type=\"i387_ext\"/>"
+    "<reg name=\"st4\" bitsize=\"80\" type=\"i387_ext\"/>"
+    "<reg name=\"st5\" bitsize=\"80\" type=\"i387_ext\"/>"
+    "<reg name=\"st6\" bitsize=\"80\" type=\"i387_ext\"/>"
+    "<reg name=\"st7\" bitsize=\"80\" type=\"i387_ext\"/>"
+    "<reg name=\"fctrl\" bitsize=\"32\" type=\"int\" group=\"float\"/>"
+    "<reg name=\"fstat\" bitsize=\"32\" type=\"int\" group=\"float\"/>"
+    "<reg name=\"ftag\" bitsize=\"32\" type=\"int\" group=\"float\"/>"
+    "<reg name=\"fiseg\" bitsize=\"32\" type=\"int\" group=\"float\"/>"
+    "<reg name=\"fioff\" bitsize=\"32\" type=\"int\" group=\"float\"/>"
+    "<reg name=\"foseg\" bitsize=\"32\" type=\"int\" group=\"float\"/>"
+    "<reg name=\"fooff\" bitsize=\"32\" type=\"int\" group=\"float\"/>"
+    "<reg name=\"fop\" bitsize=\"32\" type=\"int\" group=\"float\"/>"
+    "</feature>"
+    "<feature name=\"org.gnu.gdb.i386.sse\">"
+    "<vector id=\"v8bf16\" type=\"bfloat16\" count=\"8\"/>"
+    "<vector id=\"v4f\" type=\"ieee_single\" count=\"4\"/>"
+    "<vector id=\"v2d\" type=\"ieee_double\" count=\"2\"/>"
+    "<vector id=\"v16i8\" type=\"int8\" count=\"16\"/>"
+    "<vector id=\"v8i16\" type=\"int16\" count=\"8\"/>"
+    "<vector id=\"v4i32\" type=\"int32\" count=\"4\"/>"
+    "<vector id=\"v2i64\" type=\"int64\" count=\"2\"/>"
+    "<union id=\"vec128\">"
+    "<field name=\"v4_float\" type=\"v4f\"/>"
+    "<field name=\"v2_double\" type=\"v2d\"/>"
+    "<field name=\"v16_int8\" type=\"v16i8\"/>"
+    "<field name=\"v8_int16\" type=\"v8i16\"/>"
+    "<field name=\"v4_int32\" type=\"v4i32\"/>"
+    "<field name=\"v2_int64\" type=\"v2i64\"/>"
+    "<field name=\"uint128\" type=\"uint128\"/>"
+    "</union>"
+    "<flags id=\"i386_mxcsr\" size=\"4\">"
+    "<field name=\"IE\" start=\"0\" end=\"0\"/>"
+    "<field name=\"DE\" start=\"1\" end=\"1\"/>"
+    "<field name=\"ZE\" start=\"2\" end=\"2\"/>"
+    "<field name=\"OE\" start=\"3\" end=\"3\"/>"
+    "<field name=\"UE\" start=\"4\" end=\"4\"/>"
+    "<field name=\"PE\" start=\"5\" end=\"5\"/>"
+    "<field name=\"DAZ\" start=\"6\" end=\"6\"/>"
+    "<field name=\"IM\" start=\"7\" end=\"7\"/>"
+    "<field name=\"DM\" start=\"8\" end=\"8\"/>"
+    "<field name=\"ZM\" start=\"9\" end=\"9\"/>"
+    "<field name=\"OM\" start=\"10\" end=\"10\"/>"
+    "<field name=\"UM\" start=\"11\" end=\"11\"/>"
+    "<field name=\"PM\" start=\"12\" end=\"12\"/>"
+    "<field name=\"FZ\" start=\"15\" end=\"15\"/>"
+    "</flags>"
+    "<reg name=\"xmm0\" bitsize=\"128\" type=\"vec128\" regnum=\"40\"/>"
+    "<reg name=\"xmm1\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm2\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm3\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm4\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm5\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm6\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm7\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm8\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm9\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm10\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm11\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm12\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm13\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm14\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"xmm15\" bitsize=\"128\" type=\"vec128\"/>"
+    "<reg name=\"mxcsr\" bitsize=\"32\" type=\"i386_mxcsr\" group=\"vector\"/>"
+    "</feature>"
+    "<feature name=\"org.gnu.gdb.i386.linux\">"
+    "<reg name=\"orig_rax\" bitsize=\"64\" type=\"int\" regnum=\"57\"/>"
+    "</feature>"
+    "<feature name=\"org.gnu.gdb.i386.segments\">"
+    "<reg name=\"fs_base\" bitsize=\"64\" type=\"int\"/>"
+    "<reg name=\"gs_base\" bitsize=\"64\" type=\"int\"/>"
+    "</feature>"
+    "</target>";
+
+static int open_listener(const char *address) {
+  const char *port = strrchr(address, ':');
+  int fd;
+
+  if (port) {
+    char host[256];
+    snprintf(host, sizeof(host), "%.*s", (int)(port - address), address);
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC,
+                             .ai_socktype = SOCK_STREAM,
+                             .ai_flags = AI_PASSIVE};
+    struct addrinfo *info;
+    if (getaddrinfo(host[0] ? host : NULL, port + 1, &hints, &info) != 0) {
+      fprintf(stderr, "? Can't resolve %s.\n", address);
+      return -1;
+    }
+
+    fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (fd == -1 || bind(fd, info->ai_addr, info->ai_addrlen) == -1) {
+      perror(address);
+      freeaddrinfo(info);
+      return -1;
+    }
+    freeaddrinfo(info);
+  } else {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", address);
+    unlink(address);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+      perror(address);
+      return -1;
+    }
+  }
+
+  if (listen(fd, 1) == -1) {
+    perror(address);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static int get_char(void) {
+  if (input_pos == input_len) {
+    ssize_t len = read(client_fd, input, sizeof(input));
+    if (len <= 0)
+      return -1;
+    input_len = len;
+    input_pos = 0;
+  }
+  return (uint8_t)input[input_pos++];
+}
+
+static void send_all(const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t res = write(client_fd, data, len);
+    if (res <= 0)
+      return;
+    data += res;
+    len -= res;
+  }
+}
+
+static uint8_t checksum(const char *data, size_t len) {
+  uint8_t sum = 0;
+  for (size_t i = 0; i < len; i++) {
+    sum += (uint8_t)data[i];
+  }
+  return sum;
+}
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// returns the payload length, or -1 once the client is gone
+static ssize_t read_packet(void) {
+  while (1) {
+    int c;
+    while ((c = get_char()) != '$') {
+      if (c == -1)
+        return -1;
+    }
+
+    size_t len = 0;
+    while ((c = get_char()) != '#') {
+      if (c == -1)
+        return -1;
+      if (len < sizeof(packet) - 1)
+        packet[len++] = c;
+    }
+
+    int hi = get_char(), lo = get_char();
+    if (hi == -1 || lo == -1)
+      return -1;
+
+    packet[len] = '\0';
+
+    if (no_ack)
+      return len;
+
+    if ((hex_value(hi) << 4 | hex_value(lo)) == checksum(packet, len)) {
+      send_all("+", 1);
+      return len;
+    }
+
+    send_all("-", 1);
+  }
+}
+
+static void send_packet(const char *data, size_t len) {
+  char trailer[3];
+  snprintf(trailer, sizeof(trailer), "%02x", checksum(data, len));
+
+  while (1) {
+    send_all("$", 1);
+    send_all(data, len);
+    send_all("#", 1);
+    send_all(trailer, 2);
+
+    if (no_ack)
+      return;
+
+    int c = get_char();
+    if (c != '-')
+      return;
+  }
+}
+
+static void send_string(const char *data) { send_packet(data, strlen(data)); }
+
+static size_t encode_hex(char *out, const uint8_t *bytes, size_t len) {
+  static const char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < len; i++) {
+    out[i * 2] = digits[bytes[i] >> 4];
+    out[i * 2 + 1] = digits[bytes[i] & 0xf];
+  }
+  return len * 2;
+}
+
+static size_t decode_hex(uint8_t *out, const char *hex, size_t max) {
+  size_t len = 0;
+  while (len < max && hex_value(hex[0]) != -1 && hex_value(hex[1]) != -1) {
+    out[len++] = hex_value(hex[0]) << 4 | hex_value(hex[1]);
+    hex += 2;
+  }
+  return len;
+}
+
+// binary payloads escape '#', '$', '}' and '*' as '}' followed by c ^ 0x20
+static size_t encode_binary(char *out, const uint8_t *bytes, size_t len) {
+  size_t out_len = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (bytes[i] == '#' || bytes[i] == '$' || bytes[i] == '}' ||
+        bytes[i] == '*') {
+      out[out_len++] = '}';
+      out[out_len++] = bytes[i] ^ 0x20;
+    } else {
+      out[out_len++] = bytes[i];
+    }
+  }
+  return out_len;
+}
+
+static size_t decode_binary(uint8_t *out, const char *data, size_t len) {
+  size_t out_len = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] == '}' && i + 1 < len)
+      out[out_len++] = data[++i] ^ 0x20;
+    else
+      out[out_len++] = data[i];
+  }
+  return out_len;
+}
+
+static void refresh_registers(void) {
+  PTRACE(PTRACE_GETREGS, pid, 0, &regs);
+  invalidate_xstate();
+}
+
+// FXSAVE only keeps one "not empty" bit per register, GDB wants the full tag
+static uint16_t full_tag_word(const uint8_t *fxsave) {
+  uint16_t fsw = fxsave[2] | fxsave[3] << 8;
+  uint8_t abridged = fxsave[4];
+  size_t top = (fsw >> 11) & 7;
+  uint16_t tag = 0;
+
+  for (size_t phys = 0; phys < 8; phys++) {
+    uint16_t value;
+
+    if (!(abridged & (1 << phys))) {
+      value = 3;
+    } else {
+      const uint8_t *st = fxsave + 32 + ((phys - top) & 7) * 16;
+      uint16_t exponent = (st[8] | st[9] << 8) & 0x7fff;
+      uint64_t mantissa;
+      memcpy(&mantissa, st, sizeof(mantissa));
+
+      if (exponent == 0x7fff)
+        value = 2;
+      else if (exponent == 0)
+        value = mantissa == 0 ? 1 : 2;
+      else
+        value = mantissa >> 63 ? 0 : 2;
+    }
+
+    tag |= value << (phys * 2);
+  }
+
+  return tag;
+}
+
+static void handle_read_registers(void) {
+  const uint8_t *fxsave = get_fxsave(pid);
+  size_t len = 0;
+
+  for (size_t i = 0; i < sizeof(gdb_registers) / sizeof(gdb_registers[0]);
+       i++) {
+    uint8_t value[16] = {0};
+
+    switch (gdb_registers[i].format) {
+    case REG_GPR:
+      memcpy(value, (uint8_t *)&regs + gdb_registers[i].offset,
+             gdb_registers[i].size);
+      break;
+    case REG_FXSAVE:
+      memcpy(value, fxsave + gdb_registers[i].offset, gdb_registers[i].size);
+      break;
+    case REG_FXSAVE16:
+      // FPU control fields are 16 bits wide in FXSAVE, 32 bits in GDB
+      memcpy(value, fxsave + gdb_registers[i].offset, 2);
+      break;
+    case REG_FTAG: {
+      uint16_t tag = full_tag_word(fxsave);
+      memcpy(value, &tag, sizeof(tag));
+      break;
+    }
+    }
+
+    len += encode_hex(reply + len, value, gdb_registers[i].size);
+  }
+
+  send_packet(reply, len);
+}
+
+// only the general purpose part of G is written back, FPU/SSE state is left
+// alone
+static void handle_write_registers(const char *hex) {
+  size_t offset = 0;
+
+  for (size_t i = 0; i < sizeof(gdb_registers) / sizeof(gdb_registers[0]);
+       i++) {
+    size_t size = gdb_registers[i].size;
+    if (strlen(hex) < (offset + size) * 2)
+      break;
+
+    if (gdb_registers[i].format == REG_GPR) {
+      uint64_t value = 0;
+      decode_hex((uint8_t *)&value, hex + offset * 2, size);
+      memcpy((uint8_t *)&regs + gdb_registers[i].offset, &value, 8);
+    }
+
+    offset += size;
+  }
+
+  if (PTRACE(PTRACE_SETREGS, pid, 0, &regs) == -1) {
+    send_string("E01");
+    return;
+  }
+
+  send_string("OK");
+}
+
+static void handle_read_memory(const char *args) {
+  char *end;
+  uint64_t address = strtoull(args, &end, 16);
+  size_t length = strtoull(end + 1, NULL, 16);
+
+  if (length > PACKET_SIZE / 2)
+    length = PACKET_SIZE / 2;
+
+  uint8_t buffer[PACKET_SIZE / 2];
+  ssize_t res = read_memory(pid, address, buffer, length);
+  if (res <= 0) {
+    send_string("E14");
+    return;
+  }
+
+  send_packet(reply, encode_hex(reply, buffer, res));
+}
+
+static void handle_write_memory(const char *args, size_t args_len,
+                                bool is_binary) {
+  char *end;
+  uint64_t address = strtoull(args, &end, 16);
+  size_t length = strtoull(end + 1, &end, 16);
+  const char *data = end + 1;
+
+  uint8_t buffer[PACKET_SIZE];
+  size_t decoded;
+
+  if (is_binary)
+    decoded = decode_binary(buffer, data, args_len - (data - args));
+  else
+    decoded = decode_hex(buffer, data, sizeof(buffer));
+
+  if (decoded < length) {
+    send_string("E01");
+    return;
+  }
+
+  if (length && write_memory(pid, address, buffer, length) != (ssize_t)length) {
+    send_string("E14");
+    return;
+  }
+
+  send_string("OK");
+}
+
+static void handle_breakpoint(const char *args, bool is_insert) {
+  char type = args[0];
+  char *end;
+  uint64_t address = strtoull(args + 2, &end, 16);
+  uint8_t length = strtoul(end + 1, NULL, 16);
+
+  enum BreakpointKind kind;
+  switch (type) {
+  case '0':
+  case '1':
+    // there's no software breakpoint support, everything goes in DR0-DR3
+    kind = BP_EXECUTE;
+    break;
+  case '2':
+    kind = BP_WRITE;
+    break;
+  case '3':
+  case '4':
+    // x86 can't trap on reads alone
+    kind = BP_ACCESS;
+    break;
+  default:
+    send_string("");
+    return;
+  }
+
+  // a narrower or misaligned watch than asked for would miss accesses
+  if (kind != BP_EXECUTE &&
+      ((length != 1 && length != 2 && length != 4 && length != 8) ||
+       address % length != 0)) {
+    send_string("E22");
+    return;
+  }
+
+  if (is_insert) {
+    int id = find_breakpoint(address, kind);
+    if (id == -1)
+      id = set_breakpoint(pid, address, kind, length);
+    if (id == -1) {
+      send_string("E28");
+      return;
+    }
+    points[id].type = type;
+    points[id].address = address;
+  } else {
+    int id = find_breakpoint(address, kind);
+    if (id != -1)
+      remove_breakpoint(pid, id);
+  }
+
+  send_string("OK");
+}
+
+static char *read_file(const char *path, size_t *len) {
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return NULL;
+
+  char *data = NULL;
+  FILE *stream = open_memstream(&data, len);
+  assert(stream);
+
+  char buffer[4096];
+  size_t res;
+  while ((res = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    fwrite(buffer, 1, res, stream);
+  }
+
+  fclose(file);
+  fclose(stream);
+  return data;
+}
+
+static char *libraries_xml(size_t *len) {
+  char *data = NULL;
+  FILE *stream = open_memstream(&data, len);
+  assert(stream);
+
+  size_t count;
+  const struct Mapping *mappings = get_mappings(pid, &count);
+
+  fputs("<library-list>", stream);
+  for (size_t i = 0; i < count; i++) {
+    if (mappings[i].path[0] != '/' || mappings[i].offset != 0)
+      continue;
+    fprintf(stream, "<library name=\"%s\"><segment address=\"0x%lx\"/></library>",
+            mappings[i].path, mappings[i].start);
+  }
+  fputs("</library-list>", stream);
+
+  fclose(stream);
+  return data;
+}
+
+static void handle_xfer(const char *args) {
+  // object:read:annex:offset,length, where annex may be empty
+  char object[32], annex[64] = "";
+  int annex_start = 0, annex_end = 0;
+  size_t offset, length;
+
+  if (sscanf(args, "%31[^:]:read:%n%*[^:]%n", object, &annex_start,
+             &annex_end) < 1 ||
+      !annex_start) {
+    send_string("E00");
+    return;
+  }
+
+  if (annex_end > annex_start)
+    snprintf(annex, sizeof(annex), "%.*s", annex_end - annex_start,
+             args + annex_start);
+  else
+    annex_end = annex_start;
+
+  if (sscanf(args + annex_end, ":%zx,%zx", &offset, &length) != 2) {
+    send_string("E00");
+    return;
+  }
+
+  char *data = NULL;
+  size_t data_len = 0;
+
+  if (strcmp(object, "features") == 0 && strcmp(annex, "target.xml") == 0) {
+    data = strdup(target_xml);
+    data_len = strlen(target_xml);
+  } else if (strcmp(object, "auxv") == 0) {
+    char auxv_path[32];
+    snprintf(auxv_path, sizeof(auxv_path), "/proc/%d/auxv", pid);
+    data = read_file(auxv_path, &data_len);
+  } else if (strcmp(object, "libraries") == 0) {
+    data = libraries_xml(&data_len);
+  } else {
+    send_string("");
+    return;
+  }
+
+  if (!data) {
+    send_string("E01");
+    return;
+  }
+
+  if (offset > data_len)
+    offset = data_len;
+  if (length > data_len - offset)
+    length = data_len - offset;
+  if (length > PACKET_SIZE / 2)
+    length = PACKET_SIZE / 2;
+
+  reply[0] = offset + length < data_len ? 'm' : 'l';
+  size_t len =
+      1 + encode_binary(reply + 1, (uint8_t *)data + offset, length);
+  free(data);
+
+  send_packet(reply, len);
+}
+
+static void send_stop_reply(void) {
+  if (WIFEXITED(stop_status))
+    snprintf(reply, sizeof(reply), "W%02x", WEXITSTATUS(stop_status));
+  else if (WIFSIGNALED(stop_status))
+    snprintf(reply, sizeof(reply), "X%02x",
+             to_gdb_signal(WTERMSIG(stop_status)));
+  else {
+    int len = snprintf(reply, sizeof(reply), "T%02xthread:%x;",
+                       to_gdb_signal(WSTOPSIG(stop_status)), pid);
+
+    // gdb only reports and steps over watchpoint hits it's told about
+    if (hit_id != -1 && points[hit_id].type >= '2')
+      snprintf(reply + len, sizeof(reply) - len, "%s:%lx;",
+               points[hit_id].type == '2'   ? "watch"
+               : points[hit_id].type == '3' ? "rwatch"
+                                            : "awatch",
+               points[hit_id].address);
+    else if (hit_id != -1)
+      snprintf(reply + len, sizeof(reply) - len, "hwbreak:;");
+  }
+
+  send_string(reply);
+}
+
+static void on_sigchld(int sig) { (void)sig; }
+
+// waits for the tracee while still listening for ^C from the client.
+// SIGCHLD stays blocked outside of pselect, so a stop can't slip in between
+// checking for it and going to sleep
+static void wait_for_stop(void) {
+  siginfo_t info;
+
+  while (1) {
+    info.si_pid = 0;
+    if (waitid(P_PID, pid, &info, WEXITED | WSTOPPED | WNOHANG | WNOWAIT) ==
+            0 &&
+        info.si_pid == pid)
+      break;
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(client_fd, &fds);
+
+    if (pselect(client_fd + 1, &fds, NULL, NULL, NULL, &wait_mask) > 0) {
+      int c = get_char();
+      if (c == INTERRUPT_CHAR)
+        kill(pid, SIGINT);
+      else if (c == -1)
+        break;
+    }
+  }
+
+  WAITPID(pid, &stop_status, 0);
+  hit_id = -1;
+  if (!WIFSTOPPED(stop_status))
+    return;
+
+  refresh_registers();
+  if (WSTOPSIG(stop_status) == SIGTRAP && stop_status >> 16 == 0)
+    hit_id = take_hit_breakpoint(pid);
+}
+
+static void resume(bool is_step, int signal) {
+  apply_breakpoints(pid);
+  invalidate_mappings();
+
+  PTRACE(is_step ? PTRACE_SINGLESTEP : PTRACE_CONT, pid, 0,
+         from_gdb_signal(signal));
+
+  wait_for_stop();
+  send_stop_reply();
+}
+
+static void handle_vcont(const char *args) {
+  if (strcmp(args, "?") == 0) {
+    send_string("vCont;c;C;s;S");
+    return;
+  }
+
+  // there's only ever one thread, so the first action is the one that counts
+  if (args[0] != ';') {
+    send_string("E01");
+    return;
+  }
+
+  char action = args[1];
+  int signal = 0;
+  if (action == 'C' || action == 'S')
+    signal = strtoul(args + 2, NULL, 16);
+
+  resume(action == 's' || action == 'S', signal);
+}
+
+static bool is_running(void) {
+  return !WIFEXITED(stop_status) && !WIFSIGNALED(stop_status);
+}
+
+static bool handle_packet(size_t len) {
+  switch (packet[0]) {
+  case '?':
+    send_stop_reply();
+    return true;
+  case 'g':
+    handle_read_registers();
+    return true;
+  case 'G':
+    handle_write_registers(packet + 1);
+    return true;
+  case 'm':
+    handle_read_memory(packet + 1);
+    return true;
+  case 'M':
+    handle_write_memory(packet + 1, len - 1, false);
+    return true;
+  case 'X':
+    handle_write_memory(packet + 1, len - 1, true);
+    return true;
+  case 'Z':
+  case 'z':
+    handle_breakpoint(packet + 1, packet[0] == 'Z');
+    return true;
+  case 'c':
+  case 's':
+    resume(packet[0] == 's', 0);
+    return true;
+  case 'C':
+  case 'S':
+    resume(packet[0] == 'S', strtoul(packet + 1, NULL, 16));
+    return true;
+  case 'H':
+  case 'T':
+    send_string("OK");
+    return true;
+  case 'k':
+    return false;
+  case 'D':
+    // armed debug registers would SIGTRAP it once nobody's tracing
+    free_breakpoints(pid);
+    apply_breakpoints(pid);
+    PTRACE(PTRACE_DETACH, pid, 0, 0);
+    is_detached = true;
+    send_string("OK");
+    return false;
+  }
+
+  if (strncmp(packet, "vCont", 5) == 0) {
+    handle_vcont(packet + 5);
+  } else if (strncmp(packet, "vKill", 5) == 0) {
+    send_string("OK");
+    return false;
+  } else if (strncmp(packet, "qSupported", 10) == 0) {
+    snprintf(reply, sizeof(reply),
+             "PacketSize=%x;QStartNoAckMode+;qXfer:features:read+;"
+             "qXfer:auxv:read+;qXfer:libraries:read+;hwbreak+",
+             PACKET_SIZE);
+    send_string(reply);
+  } else if (strcmp(packet, "QStartNoAckMode") == 0) {
+    send_string("OK");
+    no_ack = true;
+  } else if (strncmp(packet, "qXfer:", 6) == 0) {
+    handle_xfer(packet + 6);
+  } else if (strcmp(packet, "qAttached") == 0) {
+    send_string("0");
+  } else if (strcmp(packet, "qC") == 0) {
+    snprintf(reply, sizeof(reply), "QC%x", pid);
+    send_string(reply);
+  } else if (strcmp(packet, "qfThreadInfo") == 0) {
+    snprintf(reply, sizeof(reply), "m%x", pid);
+    send_string(reply);
+  } else if (strcmp(packet, "qsThreadInfo") == 0) {
+    send_string("l");
+  } else if (strncmp(packet, "qSymbol", 7) == 0) {
+    send_string("OK");
+  } else {
+    send_string("");
+  }
+
+  return true;
+}
+
+int run_gdbserver(const char *address, char *argv[]) {
+  int listen_fd = open_listener(address);
+  if (listen_fd == -1)
+    return 1;
+
+  printf("listening on %s.\n", address);
+  fflush(stdout);
+
+  client_fd = accept(listen_fd, NULL, NULL);
+  close(listen_fd);
+  if (client_fd == -1) {
+    perror("accept");
+    return 1;
+  }
+
+  pid = fork();
+  if (pid == 0) {
+    close(client_fd);
+    run_tracee(argv);
+    perror(argv[0]);
+    exit(127);
+  }
+
+  sigset_t chld_mask;
+  sigemptyset(&chld_mask);
+  sigaddset(&chld_mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &chld_mask, &wait_mask);
+  sigdelset(&wait_mask, SIGCHLD);
+  sigaction(SIGCHLD, &(struct sigaction){.sa_handler = on_sigchld}, NULL);
+
+  if (!start_tracee(pid, &stop_status) || !WIFSTOPPED(stop_status)) {
+    puts("? Target didn't start.");
+    close(client_fd);
+    return 1;
+  }
+  refresh_registers();
+
+  ssize_t len;
+  while ((len = read_packet()) != -1) {
+    if (len == 0) {
+      send_string("");
+      continue;
+    }
+
+    if (!handle_packet(len))
+      break;
+  }
+
+  if (is_running() && !is_detached)
+    kill(pid, SIGKILL);
+
+  close(client_fd);
+  free_breakpoints(pid);
+  free_mappings();
+  dump_stats();
+  return 0;
+}
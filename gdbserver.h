@@ -0,0 +1,3 @@
+#pragma once
+
+int run_gdbserver(const char *address, char *argv[]);
@@ -0,0 +1,782 @@
+#include "heap.h"
+#include "lines.h"
+#include "maps.h"
+#include "memory.h"
+#include "symbols.h"
+#include "ui.h"
+#include <assert.h>
+#include <dirent.h>
+#include <elf.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+#define INT3 0xcc
+#define HEAP_STACK_DEPTH 4
+// a call nested deeper than this goes unrecorded
+#define MAX_PENDING 64
+// enough stack for the frame chain to come from a single read
+#define STACK_WINDOW 1024
+#define HEAP_TOP_SITES 10
+#define HEAP_LEAKS_SHOWN 20
+// what the traps need to hear of while they're in
+#define HEAP_OPTIONS                                                           \
+  (TRACE_OPTIONS | PTRACE_O_TRACEEXIT | PTRACE_O_TRACECLONE |                  \
+   PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACEVFORKDONE)
+
+enum Allocator : uint8_t {
+  ALLOC_MALLOC,
+  ALLOC_CALLOC,
+  ALLOC_REALLOC,
+  ALLOC_FREE,
+  ALLOC_NEW,
+  ALLOC_DELETE,
+};
+
+static const struct {
+  const char *name;
+  enum Allocator allocator;
+} functions[] = {
+    {"malloc", ALLOC_MALLOC},  {"calloc", ALLOC_CALLOC},
+    {"realloc", ALLOC_REALLOC}, {"free", ALLOC_FREE},
+    {"_Znwm", ALLOC_NEW},      {"_Znam", ALLOC_NEW},
+    {"_ZdlPv", ALLOC_DELETE},  {"_ZdaPv", ALLOC_DELETE},
+    {"_ZdlPvm", ALLOC_DELETE}, {"_ZdaPvm", ALLOC_DELETE},
+};
+
+enum TrapKind : uint8_t {
+  // the program's entry point, by then its libraries are all loaded
+  TRAP_START,
+  TRAP_CALL,
+  TRAP_RETURN,
+};
+
+// how the instruction under a call's int3 gets run. Most allocators start
+// with an endbr64 or a push, which are cheaper to emulate than to step over
+enum Displaced : uint8_t { RUN_STEP, RUN_SKIP, RUN_PUSH };
+
+// software breakpoints of our own, the four debug registers are the user's
+struct Trap {
+  uint64_t address;
+  uint8_t original;
+  enum TrapKind kind;
+  enum Allocator allocator;
+  enum Displaced displaced;
+  uint8_t length;
+  uint8_t reg;
+  // calls waiting to return here
+  uint32_t pending;
+};
+
+// an allocator call on its way back, rsp still pointing at the return address
+struct Call {
+  enum Allocator allocator;
+  uint64_t rsp;
+  uint64_t size;
+  uint64_t old_address;
+  uint64_t stack[HEAP_STACK_DEPTH];
+};
+
+struct Allocation {
+  uint64_t address;
+  uint64_t size;
+  uint64_t stack[HEAP_STACK_DEPTH];
+};
+
+static struct {
+  bool is_on;
+  struct Trap *traps;
+  size_t traps_count;
+  size_t traps_capacity;
+
+  struct Call pending[MAX_PENDING];
+  size_t pending_count;
+
+  // the trap taken out for one step, and how the tracee was running
+  bool is_stepping_over;
+  uint64_t step_address;
+  enum __ptrace_request request;
+
+  uint64_t calls;
+  uint64_t missed;
+} heap;
+
+// live allocations by address, open addressing with linear probing and
+// backward shift deletion so there are no tombstones to sweep
+static struct {
+  struct Allocation *slots;
+  size_t capacity;
+  size_t count;
+  uint8_t bits;
+  uint64_t bytes;
+} live;
+
+// push operands 0-15 in encoding order
+static const size_t register_offsets[] = {
+    offsetof(struct user_regs_struct, rax),
+    offsetof(struct user_regs_struct, rcx),
+    offsetof(struct user_regs_struct, rdx),
+    offsetof(struct user_regs_struct, rbx),
+    offsetof(struct user_regs_struct, rsp),
+    offsetof(struct user_regs_struct, rbp),
+    offsetof(struct user_regs_struct, rsi),
+    offsetof(struct user_regs_struct, rdi),
+    offsetof(struct user_regs_struct, r8),
+    offsetof(struct user_regs_struct, r9),
+    offsetof(struct user_regs_struct, r10),
+    offsetof(struct user_regs_struct, r11),
+    offsetof(struct user_regs_struct, r12),
+    offsetof(struct user_regs_struct, r13),
+    offsetof(struct user_regs_struct, r14),
+    offsetof(struct user_regs_struct, r15),
+};
+
+static size_t home_slot(uint64_t address) {
+  // allocations are 16-aligned, the low bits carry nothing
+  return ((address >> 4) * 0x9e3779b97f4a7c15ull) >> (64 - live.bits);
+}
+
+static void put_allocation(const struct Allocation *allocation);
+
+static void grow_live(void) {
+  struct Allocation *old_slots = live.slots;
+  size_t old_capacity = live.capacity;
+
+  live.bits = live.bits ? live.bits + 1 : 12;
+  live.capacity = 1ull << live.bits;
+  live.slots = calloc(live.capacity, sizeof(struct Allocation));
+  assert(live.slots);
+  live.count = 0;
+  live.bytes = 0;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_slots[i].address)
+      put_allocation(&old_slots[i]);
+  }
+  free(old_slots);
+}
+
+static struct Allocation *find_allocation(uint64_t address) {
+  if (!live.capacity)
+    return NULL;
+
+  size_t mask = live.capacity - 1;
+  for (size_t i = home_slot(address); live.slots[i].address;
+       i = (i + 1) & mask) {
+    if (live.slots[i].address == address)
+      return &live.slots[i];
+  }
+  return NULL;
+}
+
+// a reused address just replaces what was there, which is also how an
+// operator new gets the say over the malloc inside it
+static void put_allocation(const struct Allocation *allocation) {
+  if ((live.count + 1) * 4 > live.capacity * 3)
+    grow_live();
+
+  size_t mask = live.capacity - 1;
+  size_t i = home_slot(allocation->address);
+  while (live.slots[i].address && live.slots[i].address != allocation->address)
+    i = (i + 1) & mask;
+
+  if (live.slots[i].address)
+    live.bytes -= live.slots[i].size;
+  else
+    live.count++;
+  live.slots[i] = *allocation;
+  live.bytes += allocation->size;
+}
+
+static void drop_allocation(uint64_t address) {
+  struct Allocation *slot = find_allocation(address);
+  if (!slot)
+    return;
+
+  live.bytes -= slot->size;
+  live.count--;
+
+  // pull back whatever probed past the hole and could no longer be found
+  size_t mask = live.capacity - 1;
+  size_t hole = slot - live.slots;
+  for (size_t i = (hole + 1) & mask; live.slots[i].address;
+       i = (i + 1) & mask) {
+    size_t home = home_slot(live.slots[i].address);
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      live.slots[hole] = live.slots[i];
+      hole = i;
+    }
+  }
+  live.slots[hole].address = 0;
+}
+
+static void clear_live(void) {
+  free(live.slots);
+  memset(&live, 0, sizeof(live));
+}
+
+// not through read_memory, which hides the traps next door
+static bool poke_byte(int pid, uint64_t address, uint8_t byte,
+                      uint8_t *original) {
+  errno = 0;
+  uint64_t word = PTRACE(PTRACE_PEEKDATA, pid, address, 0);
+  if (errno)
+    return false;
+  if (original)
+    *original = word & 0xff;
+  word = (word & ~0xffull) | byte;
+  return PTRACE(PTRACE_POKEDATA, pid, address, word) != -1;
+}
+
+static struct Trap *find_trap(uint64_t address) {
+  for (size_t i = 0; i < heap.traps_count; i++) {
+    if (heap.traps[i].address == address)
+      return &heap.traps[i];
+  }
+  return NULL;
+}
+
+static struct Trap *add_trap(int pid, uint64_t address, enum TrapKind kind) {
+  struct Trap trap = {.address = address, .kind = kind};
+  if (!poke_byte(pid, address, INT3, &trap.original))
+    return NULL;
+
+  if (heap.traps_count == heap.traps_capacity) {
+    heap.traps_capacity = heap.traps_capacity ? heap.traps_capacity * 2 : 16;
+    heap.traps =
+        realloc(heap.traps, heap.traps_capacity * sizeof(struct Trap));
+    assert(heap.traps);
+  }
+  heap.traps[heap.traps_count] = trap;
+  return &heap.traps[heap.traps_count++];
+}
+
+static void remove_trap(int pid, struct Trap *trap) {
+  poke_byte(pid, trap->address, trap->original, NULL);
+  *trap = heap.traps[--heap.traps_count];
+}
+
+static void decode_displaced(int pid, struct Trap *trap) {
+  uint8_t code[4] = {trap->original};
+  if (read_memory(pid, trap->address + 1, code + 1, 3) != 3) {
+    trap->displaced = RUN_STEP;
+    return;
+  }
+
+  if (code[0] == 0xf3 && code[1] == 0x0f && code[2] == 0x1e &&
+      code[3] == 0xfa) {
+    trap->displaced = RUN_SKIP;
+    trap->length = 4;
+  } else if (code[0] >= 0x50 && code[0] <= 0x57) {
+    trap->displaced = RUN_PUSH;
+    trap->reg = code[0] - 0x50;
+    trap->length = 1;
+  } else if (code[0] == 0x41 && code[1] >= 0x50 && code[1] <= 0x57) {
+    trap->displaced = RUN_PUSH;
+    trap->reg = code[1] - 0x50 + 8;
+    trap->length = 2;
+  } else {
+    trap->displaced = RUN_STEP;
+  }
+}
+
+// reads see the code the traps stand in for
+void overlay_traps(uint64_t address, void *buffer, size_t length) {
+  for (size_t i = 0; i < heap.traps_count; i++) {
+    const struct Trap *trap = &heap.traps[i];
+    if (trap->address >= address && trap->address - address < length)
+      ((uint8_t *)buffer)[trap->address - address] = trap->original;
+  }
+}
+
+// a write over a trap changes the code it stands in for, the int3 goes back
+// on top of it
+void rearm_traps(int pid, uint64_t address, size_t length) {
+  for (size_t i = 0; i < heap.traps_count; i++) {
+    struct Trap *trap = &heap.traps[i];
+    if (trap->address + 4 <= address || trap->address >= address + length)
+      continue;
+    if (trap->address >= address)
+      poke_byte(pid, trap->address, INT3, &trap->original);
+    if (trap->kind == TRAP_CALL)
+      decode_displaced(pid, trap);
+  }
+}
+
+static size_t add_call_traps(int pid) {
+  size_t count = 0;
+  for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+    uint64_t address;
+    if (!find_symbol(pid, functions[i].name, &address) || find_trap(address))
+      continue;
+
+    struct Trap *trap = add_trap(pid, address, TRAP_CALL);
+    if (!trap)
+      continue;
+    trap->allocator = functions[i].allocator;
+    decode_displaced(pid, trap);
+    count++;
+  }
+  return count;
+}
+
+static uint64_t find_entry_point(int pid) {
+  char auxv_path[32];
+  snprintf(auxv_path, sizeof(auxv_path), "/proc/%d/auxv", pid);
+
+  FILE *file = fopen(auxv_path, "r");
+  if (!file)
+    return 0;
+
+  uint64_t entry[2], address = 0;
+  while (fread(entry, sizeof(entry), 1, file) == 1 && entry[0] != AT_NULL) {
+    if (entry[0] == AT_ENTRY)
+      address = entry[1];
+  }
+  fclose(file);
+  return address;
+}
+
+// only the thread we trace gets its int3s handled, any other would die of one
+static size_t count_threads(int pid) {
+  char task_path[32];
+  snprintf(task_path, sizeof(task_path), "/proc/%d/task", pid);
+
+  DIR *dir = opendir(task_path);
+  if (!dir)
+    return 0;
+
+  size_t count = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    if (entry->d_name[0] != '.')
+      count++;
+  }
+  closedir(dir);
+  return count;
+}
+
+bool is_heap_tracking(void) { return heap.is_on; }
+
+void start_heap_tracking(int pid) {
+  if (heap.is_on) {
+    puts("? heaptrack is already on.");
+    return;
+  }
+
+  if (count_threads(pid) > 1) {
+    puts("? heaptrack can't follow a threaded target.");
+    return;
+  }
+
+  clear_live();
+  heap.pending_count = 0;
+  heap.calls = 0;
+  heap.missed = 0;
+
+  invalidate_mappings();
+  size_t count = add_call_traps(pid);
+  if (count == 0) {
+    // straight after the exec only the dynamic loader is there
+    uint64_t entry = find_entry_point(pid);
+    struct user_regs_struct regs;
+    PTRACE(PTRACE_GETREGS, pid, 0, &regs);
+    if (!entry || regs.rip == entry || !add_trap(pid, entry, TRAP_START)) {
+      puts("? No allocator to track.");
+      return;
+    }
+    puts("tracking allocations from the entry point.");
+  } else {
+    printf("tracking %zu allocator functions.\n", count);
+  }
+
+  // a last look at the leaks before it's gone, and a word of any thread or
+  // child before it can run into a trap
+  PTRACE(PTRACE_SETOPTIONS, pid, 0, HEAP_OPTIONS);
+  heap.is_on = true;
+}
+
+static void pull_traps(int pid) {
+  while (heap.traps_count > 0)
+    remove_trap(pid, &heap.traps[0]);
+  heap.pending_count = 0;
+  heap.is_stepping_over = false;
+  heap.is_on = false;
+  // none of HEAP_OPTIONS' events are wanted any more
+  PTRACE(PTRACE_SETOPTIONS, pid, 0, TRACE_OPTIONS);
+}
+
+void stop_heap_tracking(int pid) {
+  if (!heap.is_on) {
+    puts("? heaptrack is already off.");
+    return;
+  }
+
+  pull_traps(pid);
+  printf("%zu allocations, %lu bytes live.\n", live.count, live.bytes);
+}
+
+// the new thread was attached for us and can't run before it's let go, by
+// which time there's no trap left for it to hit
+static void drop_thread(int pid) {
+  unsigned long thread;
+  PTRACE(PTRACE_GETEVENTMSG, pid, 0, &thread);
+  pull_traps(pid);
+
+  int status;
+  if (WAITPID(thread, &status, __WALL) == (pid_t)thread)
+    PTRACE(PTRACE_DETACH, thread, 0, 0);
+  printf("? heaptrack can't follow a threaded target, stopped with %zu "
+         "allocations.\n",
+         live.count);
+}
+
+// a forked child got a copy of the traps and nobody to catch them. It was
+// attached for us, so the original bytes go back in before it's let go. A
+// vfork child shares our memory instead, that's where they come out of until
+// it's done with it, and we're held until then anyway
+static void drop_child(int pid) {
+  unsigned long child;
+  PTRACE(PTRACE_GETEVENTMSG, pid, 0, &child);
+
+  int status;
+  if (WAITPID(child, &status, __WALL) != (pid_t)child)
+    return;
+  for (size_t i = 0; i < heap.traps_count; i++)
+    poke_byte(child, heap.traps[i].address, heap.traps[i].original, NULL);
+  PTRACE(PTRACE_DETACH, child, 0, 0);
+}
+
+static void rearm_after_vfork(int pid) {
+  for (size_t i = 0; i < heap.traps_count; i++)
+    poke_byte(pid, heap.traps[i].address, INT3, NULL);
+}
+
+// the return address, then whatever the frame pointer chain gives, all out of
+// one read of the stack
+static void read_call_stack(int pid, const struct user_regs_struct *regs,
+                            uint64_t stack[HEAP_STACK_DEPTH]) {
+  uint64_t window[STACK_WINDOW / 8];
+  memset(stack, 0, HEAP_STACK_DEPTH * sizeof(uint64_t));
+
+  ssize_t got = read_memory(pid, regs->rsp, window, sizeof(window));
+  if (got < 8)
+    return;
+  uint64_t end = regs->rsp + got;
+
+  stack[0] = window[0];
+  uint64_t frame = regs->rbp;
+  for (size_t i = 1; i < HEAP_STACK_DEPTH; i++) {
+    if (frame <= regs->rsp || frame + 16 > end || frame % 8)
+      break;
+    size_t index = (frame - regs->rsp) / 8;
+    stack[i] = window[index + 1];
+    frame = window[index];
+  }
+}
+
+static void release_return(int pid, uint64_t address) {
+  struct Trap *trap = find_trap(address);
+  if (trap && trap->kind == TRAP_RETURN && --trap->pending == 0)
+    remove_trap(pid, trap);
+}
+
+static void note_call(int pid, const struct user_regs_struct *regs,
+                      enum Allocator allocator) {
+  heap.calls++;
+
+  if (allocator == ALLOC_FREE || allocator == ALLOC_DELETE) {
+    drop_allocation(regs->rdi);
+    return;
+  }
+
+  // operator new[] tail calls operator new, one return for the both of them
+  if (heap.pending_count > 0 &&
+      heap.pending[heap.pending_count - 1].rsp == regs->rsp)
+    return;
+
+  if (heap.pending_count == MAX_PENDING) {
+    heap.missed++;
+    return;
+  }
+
+  struct Call *call = &heap.pending[heap.pending_count];
+  call->allocator = allocator;
+  call->rsp = regs->rsp;
+  call->old_address = 0;
+  call->size = regs->rdi;
+  if (allocator == ALLOC_CALLOC) {
+    call->size = regs->rdi * regs->rsi;
+  } else if (allocator == ALLOC_REALLOC) {
+    call->old_address = regs->rdi;
+    call->size = regs->rsi;
+  }
+  read_call_stack(pid, regs, call->stack);
+
+  struct Trap *trap = find_trap(call->stack[0]);
+  if (!trap)
+    trap = add_trap(pid, call->stack[0], TRAP_RETURN);
+  if (!trap || trap->kind != TRAP_RETURN) {
+    heap.missed++;
+    return;
+  }
+  trap->pending++;
+  heap.pending_count++;
+}
+
+static void note_return(int pid, const struct user_regs_struct *regs) {
+  uint64_t address = regs->rip;
+
+  // rip also comes by here without a call of ours returning
+  size_t i = heap.pending_count;
+  while (i > 0 && (heap.pending[i - 1].stack[0] != address ||
+                   heap.pending[i - 1].rsp + 8 != regs->rsp))
+    i--;
+  if (i == 0)
+    return;
+
+  struct Call *call = &heap.pending[i - 1];
+  if (call->old_address && (regs->rax || call->size == 0))
+    drop_allocation(call->old_address);
+  if (regs->rax) {
+    struct Allocation allocation = {regs->rax, call->size, {0}};
+    memcpy(allocation.stack, call->stack, sizeof(call->stack));
+    put_allocation(&allocation);
+  }
+
+  // and any deeper call that was longjmp'ed or thrown out of
+  while (heap.pending_count >= i)
+    release_return(pid, heap.pending[--heap.pending_count].stack[0]);
+}
+
+static void step_over(int pid, struct Trap *trap) {
+  poke_byte(pid, trap->address, trap->original, NULL);
+  heap.is_stepping_over = true;
+  heap.step_address = trap->address;
+  PTRACE(PTRACE_SINGLESTEP, pid, 0, 0);
+}
+
+// called on every stop, true when the stop was an allocator call and the
+// tracee is running again
+bool continue_heap_tracking(int pid, struct user_regs_struct *regs,
+                            enum StopCause cause) {
+  if (!heap.is_on)
+    return false;
+
+  // the old image took our traps with it
+  if (cause == STOP_EXEC) {
+    heap.traps_count = 0;
+    heap.pending_count = 0;
+    heap.is_stepping_over = false;
+    heap.is_on = false;
+    return false;
+  }
+
+  if (heap.is_stepping_over) {
+    heap.is_stepping_over = false;
+    poke_byte(pid, heap.step_address, INT3, NULL);
+    if (cause != STOP_STEP || heap.request == PTRACE_SINGLESTEP)
+      return false;
+    PTRACE(heap.request, pid, 0, 0);
+    return true;
+  }
+
+  if (cause == STOP_CLONE) {
+    drop_thread(pid);
+    PTRACE(get_last_resume(), pid, 0, 0);
+    return true;
+  }
+
+  if (cause == STOP_FORK || cause == STOP_VFORK_DONE) {
+    if (cause == STOP_FORK)
+      drop_child(pid);
+    else
+      rearm_after_vfork(pid);
+    PTRACE(get_last_resume(), pid, 0, 0);
+    return true;
+  }
+
+  if (cause != STOP_BREAKPOINT && cause != STOP_STEP)
+    return false;
+
+  struct Trap *trap = find_trap(regs->rip - 1);
+  if (!trap)
+    return false;
+
+  heap.request = get_last_resume();
+  regs->rip = trap->address;
+  struct Trap *stepped = NULL;
+
+  if (trap->kind == TRAP_START) {
+    remove_trap(pid, trap);
+    invalidate_mappings();
+    if (add_call_traps(pid) == 0) {
+      puts("? No allocator to track.");
+      heap.is_on = false;
+      PTRACE(PTRACE_SETREGS, pid, 0, regs);
+      return false;
+    }
+  } else if (trap->kind == TRAP_RETURN) {
+    note_return(pid, regs);
+    // still there when an outer call returns to the same place
+    stepped = find_trap(regs->rip);
+  } else {
+    note_call(pid, regs, trap->allocator);
+    // the return trap may have moved the array
+    trap = find_trap(regs->rip);
+
+    if (trap->displaced == RUN_SKIP) {
+      regs->rip += trap->length;
+    } else if (trap->displaced == RUN_PUSH) {
+      uint64_t value = *(uint64_t *)((uint8_t *)regs +
+                                     register_offsets[trap->reg]);
+      regs->rsp -= 8;
+      PTRACE(PTRACE_POKEDATA, pid, regs->rsp, value);
+      regs->rip += trap->length;
+    } else {
+      stepped = trap;
+    }
+  }
+
+  PTRACE(PTRACE_SETREGS, pid, 0, regs);
+  if (stepped) {
+    step_over(pid, stepped);
+    return true;
+  }
+
+  // a single step that ran into a trap has done its one instruction
+  if (heap.request == PTRACE_SINGLESTEP)
+    return false;
+  PTRACE(heap.request, pid, 0, 0);
+  return true;
+}
+
+static void print_stack(int pid, const uint64_t stack[HEAP_STACK_DEPTH]) {
+  for (size_t i = 0; i < HEAP_STACK_DEPTH && stack[i]; i++) {
+    if (i > 0)
+      printf(" ◂");
+    printf(" " YELLOW("0x%lx"), stack[i]);
+
+    // the call is the instruction before the return address
+    struct SourceLine line;
+    const struct Mapping *mapping;
+    if (find_line(pid, stack[i] - 1, &line)) {
+      const char *name = strrchr(line.file, '/');
+      printf(" %s:%u", name ? name + 1 : line.file, line.line);
+    } else if ((mapping = find_mapping(pid, stack[i])) && mapping->path[0]) {
+      const char *name = strrchr(mapping->path, '/');
+      printf(" (%s)", name ? name + 1 : mapping->path);
+    }
+  }
+  putchar('\n');
+}
+
+// the live allocations packed together, for sorting
+static struct Allocation *copy_live(void) {
+  struct Allocation *allocations =
+      malloc((live.count ? live.count : 1) * sizeof(struct Allocation));
+  assert(allocations);
+
+  size_t count = 0;
+  for (size_t i = 0; i < live.capacity; i++) {
+    if (live.slots[i].address)
+      allocations[count++] = live.slots[i];
+  }
+  return allocations;
+}
+
+static int compare_stacks(const void *a, const void *b) {
+  return memcmp(((const struct Allocation *)a)->stack,
+                ((const struct Allocation *)b)->stack,
+                sizeof(((const struct Allocation *)a)->stack));
+}
+
+// bigger first
+static int compare_sizes(const void *a, const void *b) {
+  uint64_t lhs = ((const struct Allocation *)a)->size;
+  uint64_t rhs = ((const struct Allocation *)b)->size;
+  return (lhs < rhs) - (lhs > rhs);
+}
+
+static void print_summary(void) {
+  printf("%zu allocations, %lu bytes live, %lu allocator calls", live.count,
+         live.bytes, heap.calls);
+  if (heap.missed)
+    printf(", %lu missed", heap.missed);
+  puts(".");
+}
+
+// call sites by the bytes they still hold. Sites get aggregated here rather
+// than on every call, which stays as cheap as a hash map update
+void print_heap_top(int pid) {
+  struct Allocation *allocations = copy_live();
+  qsort(allocations, live.count, sizeof(*allocations), compare_stacks);
+
+  // folded in place, size becomes the site's bytes and address its count
+  size_t sites = 0;
+  for (size_t i = 0; i < live.count; i++) {
+    if (sites > 0 && compare_stacks(&allocations[sites - 1],
+                                    &allocations[i]) == 0) {
+      allocations[sites - 1].size += allocations[i].size;
+      allocations[sites - 1].address++;
+      continue;
+    }
+    allocations[sites] = allocations[i];
+    allocations[sites++].address = 1;
+  }
+  qsort(allocations, sites, sizeof(*allocations), compare_sizes);
+
+  if (sites > 0)
+    puts("       bytes   allocations  call site");
+  for (size_t i = 0; i < sites && i < HEAP_TOP_SITES; i++) {
+    printf("%12lu  %12lu ", allocations[i].size, allocations[i].address);
+    print_stack(pid, allocations[i].stack);
+  }
+
+  free(allocations);
+  print_summary();
+}
+
+// what's still live, which once the target is about to exit is what leaked
+void print_heap_leaks(int pid) {
+  struct Allocation *allocations = copy_live();
+  qsort(allocations, live.count, sizeof(*allocations), compare_sizes);
+
+  for (size_t i = 0; i < live.count && i < HEAP_LEAKS_SHOWN; i++) {
+    printf("   " YELLOW("0x%lx") " %10lu bytes ", allocations[i].address,
+           allocations[i].size);
+    print_stack(pid, allocations[i].stack);
+  }
+  if (live.count > HEAP_LEAKS_SHOWN)
+    printf("   ... and %zu more.\n", live.count - HEAP_LEAKS_SHOWN);
+
+  free(allocations);
+  print_summary();
+}
+
+void print_heap_find(int pid, uint64_t address) {
+  // only keyed by start, so anything inside takes a scan
+  for (size_t i = 0; i < live.capacity; i++) {
+    const struct Allocation *allocation = &live.slots[i];
+    if (!allocation->address || address < allocation->address ||
+        address - allocation->address >= allocation->size)
+      continue;
+
+    printf("0x%lx is %lu bytes into a %lu byte allocation at 0x%lx, from",
+           address, address - allocation->address, allocation->size,
+           allocation->address);
+    print_stack(pid, allocation->stack);
+    return;
+  }
+  printf("? 0x%lx isn't in a live allocation.\n", address);
+}
+
+void free_heap(void) {
+  clear_live();
+  free(heap.traps);
+  memset(&heap, 0, sizeof(heap));
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "stats.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/user.h>
+
+void start_heap_tracking(int pid);
+void stop_heap_tracking(int pid);
+bool is_heap_tracking(void);
+bool continue_heap_tracking(int pid, struct user_regs_struct *regs,
+                            enum StopCause cause);
+void overlay_traps(uint64_t address, void *buffer, size_t length);
+void rearm_traps(int pid, uint64_t address, size_t length);
+void print_heap_top(int pid);
+void print_heap_leaks(int pid);
+void print_heap_find(int pid, uint64_t address);
+void free_heap(void);
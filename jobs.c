@@ -0,0 +1,231 @@
+#include "jobs.h"
+#include "stats.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PLACEHOLDER "{}"
+
+// every target gets a whole debugger process to itself: ptrace only answers
+// to the tracer that attached, and none of the per-session state is shared.
+// Neither are the symbol, line and CFG caches, they're only built once a
+// worker has its tracee, so each worker builds its own. What the workers do
+// share is the executable's pages, through the page cache
+struct Job {
+  pid_t worker;
+  int output_fd;
+  char *target;
+  char *output;
+  size_t output_len;
+  FILE *output_stream;
+};
+
+extern int debug(char *argv[], FILE *script);
+
+bool has_placeholder(char *argv[]) {
+  for (size_t i = 0; argv[i]; i++) {
+    if (strstr(argv[i], PLACEHOLDER))
+      return true;
+  }
+  return false;
+}
+
+static char *substitute(const char *arg, const char *target) {
+  const char *at = strstr(arg, PLACEHOLDER);
+  if (!at)
+    return strdup(arg);
+
+  size_t len = strlen(arg) - strlen(PLACEHOLDER) + strlen(target) + 1;
+  char *result = malloc(len);
+  assert(result);
+
+  snprintf(result, len, "%.*s%s%s", (int)(at - arg), arg, target,
+           at + strlen(PLACEHOLDER));
+  return result;
+}
+
+static void run_worker(const char *script_path, char *argv[],
+                       const char *target) {
+  size_t argc = 0;
+  while (argv[argc])
+    argc++;
+
+  char *target_argv[argc + 1];
+  for (size_t i = 0; i < argc; i++) {
+    target_argv[i] = substitute(argv[i], target);
+  }
+  target_argv[argc] = NULL;
+
+  // so that parallel targets don't all dump their counters to the same file
+  if (get_stats_path())
+    set_stats_path(substitute(get_stats_path(), target));
+
+  FILE *script = fopen(script_path, "r");
+  if (!script) {
+    perror(script_path);
+    exit(1);
+  }
+
+  exit(debug(target_argv, script));
+}
+
+static bool start_job(struct Job *job, const char *script_path, char *argv[]) {
+  int fds[2];
+  if (pipe(fds) == -1) {
+    perror("pipe");
+    return false;
+  }
+
+  job->worker = fork();
+  if (job->worker == -1) {
+    perror("fork");
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+
+  if (job->worker == 0) {
+    // the target list comes in on stdin, keep it away from the tracee
+    int null_fd = open("/dev/null", O_RDONLY);
+    dup2(null_fd, STDIN_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    close(null_fd);
+    close(fds[0]);
+    close(fds[1]);
+    run_worker(script_path, argv, job->target);
+  }
+
+  close(fds[1]);
+  job->output_fd = fds[0];
+  job->output_stream = open_memstream(&job->output, &job->output_len);
+  assert(job->output_stream);
+  return true;
+}
+
+// the collector: output is held back until a job finishes, so reports from
+// parallel targets never interleave
+static int finish_job(struct Job *job, size_t index) {
+  int status;
+  waitpid(job->worker, &status, 0);
+  close(job->output_fd);
+  fclose(job->output_stream);
+
+  int result = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+  printf("==> [%zu] %s (%d)\n", index, job->target, result);
+  fwrite(job->output, 1, job->output_len, stdout);
+  if (job->output_len && job->output[job->output_len - 1] != '\n')
+    putchar('\n');
+  fflush(stdout);
+
+  free(job->output);
+  free(job->target);
+  return result;
+}
+
+static char *next_target(void) {
+  char *line = NULL;
+  size_t len = 0;
+
+  while (getline(&line, &len, stdin) != -1) {
+    line[strcspn(line, "\n")] = '\0';
+    if (line[0])
+      return line;
+  }
+
+  free(line);
+  return NULL;
+}
+
+// once a worker couldn't be started the rest wouldn't either, but every
+// target still gets a line in the report
+static size_t skip_targets(char *target, size_t index) {
+  size_t count = 0;
+  do {
+    printf("==> [%zu] %s (skipped)\n", index + count++, target);
+    free(target);
+  } while ((target = next_target()));
+  return count;
+}
+
+int run_jobs(size_t jobs, const char *script_path, char *argv[]) {
+  // jobs get shuffled around as they finish, and their memstreams hold on to
+  // the output buffer fields, so they can't move
+  struct Job *running[jobs];
+  struct pollfd fds[jobs];
+  size_t indices[jobs];
+  size_t running_count = 0;
+  size_t started = 0, failed = 0;
+  bool has_targets = true;
+
+  fflush(stdout);
+
+  while (has_targets || running_count > 0) {
+    while (has_targets && running_count < jobs) {
+      struct Job *job = calloc(1, sizeof(struct Job));
+      assert(job);
+
+      if (!(job->target = next_target())) {
+        free(job);
+        has_targets = false;
+        break;
+      }
+      if (!start_job(job, script_path, argv)) {
+        size_t skipped = skip_targets(job->target, started);
+        started += skipped;
+        failed += skipped;
+        free(job);
+        has_targets = false;
+        break;
+      }
+
+      running[running_count] = job;
+      indices[running_count++] = started++;
+    }
+
+    if (running_count == 0)
+      break;
+
+    for (size_t i = 0; i < running_count; i++) {
+      fds[i] = (struct pollfd){.fd = running[i]->output_fd, .events = POLLIN};
+    }
+
+    if (poll(fds, running_count, -1) == -1) {
+      perror("poll");
+      break;
+    }
+
+    for (size_t i = 0; i < running_count; i++) {
+      if (!fds[i].revents)
+        continue;
+
+      char buffer[4096];
+      ssize_t len = read(running[i]->output_fd, buffer, sizeof(buffer));
+      if (len > 0) {
+        fwrite(buffer, 1, len, running[i]->output_stream);
+        continue;
+      }
+
+      if (finish_job(running[i], indices[i]) != 0)
+        failed++;
+      free(running[i]);
+
+      // keep the running jobs packed at the front
+      running_count--;
+      running[i] = running[running_count];
+      indices[i] = indices[running_count];
+      fds[i] = fds[running_count];
+      i--;
+    }
+  }
+
+  printf("%zu targets, %zu failed.\n", started, failed);
+  return failed != 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool has_placeholder(char *argv[]);
+int run_jobs(size_t jobs, const char *script_path, char *argv[]);
@@ -0,0 +1,276 @@
+#define _GNU_SOURCE
+#include "journal.h"
+#include "heap.h"
+#include "maps.h"
+#include "memory.h"
+#include "render.h"
+#include "stats.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+
+extern struct user_regs_struct regs;
+
+extern const struct {
+  char *name;
+  enum Register reg;
+} registers[];
+
+// a write as it was asked for, with what it overwrote for undo. Registers
+// keep their 8 bytes in here too
+struct Entry {
+  bool is_register;
+  enum Register reg;
+  uint64_t address;
+  size_t length;
+  uint8_t *old_bytes;
+  uint8_t *new_bytes;
+};
+
+// one contiguous run of staged bytes, the unit of a flush
+struct Range {
+  uint64_t start;
+  uint64_t end;
+  uint8_t *data;
+};
+
+// everything from staged on hasn't reached the tracee yet. Staged registers
+// are already in regs and go out with a single PTRACE_SETREGS
+static struct {
+  struct Entry *entries;
+  size_t count;
+  size_t capacity;
+  size_t staged;
+  bool has_registers;
+} journal;
+
+// filled in at the end of the journal, and only counted once it's complete
+static struct Entry *new_entry(size_t length) {
+  if (journal.count == journal.capacity) {
+    journal.capacity = journal.capacity ? journal.capacity * 2 : 16;
+    journal.entries =
+        realloc(journal.entries, journal.capacity * sizeof(struct Entry));
+    assert(journal.entries);
+  }
+
+  struct Entry *entry = &journal.entries[journal.count];
+  memset(entry, 0, sizeof(*entry));
+  entry->length = length;
+  entry->old_bytes = malloc(length);
+  entry->new_bytes = malloc(length);
+  assert(entry->old_bytes && entry->new_bytes);
+  return entry;
+}
+
+static void free_entry(struct Entry *entry) {
+  free(entry->old_bytes);
+  free(entry->new_bytes);
+}
+
+bool stage_memory(int pid, uint64_t address, const void *bytes,
+                  size_t length) {
+  struct Entry *entry = new_entry(length);
+  entry->address = address;
+  memcpy(entry->new_bytes, bytes, length);
+
+  // through the overlay, so undo goes back to what an earlier write staged
+  if (read_memory(pid, address, entry->old_bytes, length) != (ssize_t)length) {
+    free_entry(entry);
+    return false;
+  }
+  journal.count++;
+  return true;
+}
+
+void stage_register(enum Register reg, uint64_t value) {
+  uint64_t *slot = (uint64_t *)&regs + reg;
+
+  struct Entry *entry = new_entry(sizeof(uint64_t));
+  journal.count++;
+  entry->is_register = true;
+  entry->reg = reg;
+  memcpy(entry->old_bytes, slot, sizeof(uint64_t));
+  memcpy(entry->new_bytes, &value, sizeof(uint64_t));
+
+  *slot = value;
+  journal.has_registers = true;
+}
+
+// reads see the tracee as it will be once the journal is flushed
+void overlay_staged(uint64_t address, void *buffer, size_t length) {
+  for (size_t i = journal.staged; i < journal.count; i++) {
+    const struct Entry *entry = &journal.entries[i];
+    if (entry->is_register || entry->address >= address + length ||
+        entry->address + entry->length <= address)
+      continue;
+
+    uint64_t start = entry->address > address ? entry->address : address;
+    uint64_t end = entry->address + entry->length < address + length
+                       ? entry->address + entry->length
+                       : address + length;
+    memcpy((uint8_t *)buffer + (start - address),
+           entry->new_bytes + (start - entry->address), end - start);
+  }
+}
+
+static int compare_ranges(const void *a, const void *b) {
+  uint64_t lhs = ((const struct Range *)a)->start;
+  uint64_t rhs = ((const struct Range *)b)->start;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+static bool is_writable(int pid, const struct Range *range) {
+  const struct Mapping *mapping = find_mapping(pid, range->start);
+  return mapping && mapping->perms[1] == 'w' && range->end <= mapping->end;
+}
+
+// staged writes merged into ranges, later writes winning where they overlap
+static size_t merge_ranges(struct Range *ranges) {
+  size_t count = 0;
+  for (size_t i = journal.staged; i < journal.count; i++) {
+    const struct Entry *entry = &journal.entries[i];
+    if (!entry->is_register)
+      ranges[count++] = (struct Range){entry->address,
+                                       entry->address + entry->length, NULL};
+  }
+  if (count == 0)
+    return 0;
+
+  qsort(ranges, count, sizeof(*ranges), compare_ranges);
+  size_t merged = 0;
+  for (size_t i = 1; i < count; i++) {
+    if (ranges[i].start <= ranges[merged].end) {
+      if (ranges[i].end > ranges[merged].end)
+        ranges[merged].end = ranges[i].end;
+    } else {
+      ranges[++merged] = ranges[i];
+    }
+  }
+  merged++;
+
+  for (size_t i = 0; i < merged; i++) {
+    ranges[i].data = malloc(ranges[i].end - ranges[i].start);
+    assert(ranges[i].data);
+    overlay_staged(ranges[i].start, ranges[i].data,
+                   ranges[i].end - ranges[i].start);
+  }
+  return merged;
+}
+
+// registers move on once the tracee runs, undoing one would put back a
+// value from before then. Memory entries stay undoable
+static void drop_registers(void) {
+  size_t kept = 0;
+  for (size_t i = 0; i < journal.count; i++) {
+    if (journal.entries[i].is_register)
+      free_entry(&journal.entries[i]);
+    else
+      journal.entries[kept++] = journal.entries[i];
+  }
+  journal.count = kept;
+}
+
+// the staged memory in one process_vm_writev, read-only text through
+// /proc/pid/mem, and the registers in one PTRACE_SETREGS. Called right
+// before the tracee resumes
+void flush_journal(int pid) {
+  if (journal.has_registers)
+    PTRACE(PTRACE_SETREGS, pid, 0, &regs);
+  journal.has_registers = false;
+
+  size_t staged = journal.count - journal.staged;
+  if (staged == 0)
+    return;
+
+  struct Range ranges[staged];
+  size_t count = merge_ranges(ranges);
+
+  struct iovec local[count ? count : 1], remote[count ? count : 1];
+  size_t writable = 0;
+  ssize_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t length = ranges[i].end - ranges[i].start;
+    if (!is_writable(pid, &ranges[i])) {
+      if (write_memory(pid, ranges[i].start, ranges[i].data, length) !=
+          (ssize_t)length)
+        printf("? Couldn't write 0x%lx.\n", ranges[i].start);
+      continue;
+    }
+    local[writable] = (struct iovec){ranges[i].data, length};
+    remote[writable++] = (struct iovec){(void *)ranges[i].start, length};
+    total += length;
+  }
+
+  // process_vm_writev stops at the first range it can't write
+  if (writable > 0 &&
+      process_vm_writev(pid, local, writable, remote, writable, 0) != total) {
+    for (size_t i = 0; i < writable; i++) {
+      if (write_memory(pid, (uint64_t)remote[i].iov_base, local[i].iov_base,
+                       local[i].iov_len) != (ssize_t)local[i].iov_len)
+        printf("? Couldn't write 0x%lx.\n", (uint64_t)remote[i].iov_base);
+    }
+  } else {
+    // write_memory does this for the rest
+    for (size_t i = 0; i < writable; i++)
+      rearm_traps(pid, (uint64_t)remote[i].iov_base, local[i].iov_len);
+  }
+
+  for (size_t i = 0; i < count; i++)
+    free(ranges[i].data);
+
+  // x86 keeps its instruction cache coherent with these writes, the only
+  // stale copy of the code is the one the view disassembled
+  if (count > 0)
+    frame_invalidate();
+  drop_registers();
+  journal.staged = journal.count;
+}
+
+static const char *register_name(enum Register reg) {
+  for (size_t i = 0; i < REGISTERS_COUNT; i++) {
+    if (registers[i].reg == reg)
+      return registers[i].name;
+  }
+  return "?";
+}
+
+// the last write, whether it already reached the tracee or not. Registers
+// only while they're staged, see drop_registers()
+bool undo_journal(int pid) {
+  if (journal.count == 0)
+    return false;
+
+  struct Entry *entry = &journal.entries[journal.count - 1];
+  bool is_flushed = journal.count == journal.staged;
+
+  if (entry->is_register) {
+    memcpy((uint64_t *)&regs + entry->reg, entry->old_bytes,
+           sizeof(uint64_t));
+    journal.has_registers = true;
+    printf("undid $%s.\n", register_name(entry->reg));
+  } else {
+    // it's out already, put the old bytes straight back
+    if (is_flushed &&
+        write_memory(pid, entry->address, entry->old_bytes, entry->length) !=
+            (ssize_t)entry->length)
+      printf("? Couldn't write 0x%lx.\n", entry->address);
+    printf("undid %zu bytes at 0x%lx.\n", entry->length, entry->address);
+  }
+
+  free_entry(entry);
+  journal.count--;
+  if (is_flushed)
+    journal.staged = journal.count;
+  return true;
+}
+
+void free_journal(void) {
+  for (size_t i = 0; i < journal.count; i++)
+    free_entry(&journal.entries[i]);
+  free(journal.entries);
+  memset(&journal, 0, sizeof(journal));
+}
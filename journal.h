@@ -0,0 +1,13 @@
+#pragma once
+
+#include "lexer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+bool stage_memory(int pid, uint64_t address, const void *bytes, size_t length);
+void stage_register(enum Register reg, uint64_t value);
+void overlay_staged(uint64_t address, void *buffer, size_t length);
+void flush_journal(int pid);
+bool undo_journal(int pid);
+void free_journal(void);
@@ -1,4 +1,5 @@
 #include "lexer.h"
+#include "xstate.h"
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -72,6 +73,11 @@ struct Token next_token(struct Lexer *lexer) {
       }
     }
 
+    enum Register reg;
+    if (parse_xreg(start, lexer->current - start, &reg)) {
+      return (struct Token){.type = TOK_REGISTER, .value.as_register = reg};
+    }
+
     return (struct Token){.type = TOK_INVALID};
   }
 
@@ -125,5 +131,15 @@ struct Token next_token(struct Lexer *lexer) {
     return (struct Token){.type = TOK_RPAREN};
   }
 
+  if (*lexer->current == '[') {
+    lexer->current++;
+    return (struct Token){.type = TOK_LBRACKET};
+  }
+
+  if (*lexer->current == ']') {
+    lexer->current++;
+    return (struct Token){.type = TOK_RBRACKET};
+  }
+
   return (struct Token){.type = TOK_INVALID};
 }
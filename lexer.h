@@ -31,7 +31,15 @@ enum Register : uint8_t {
   REG_ES,
   REG_FS,
   REG_GS,
-  REGISTERS_COUNT
+  REGISTERS_COUNT,
+  // everything past here lives in the XSAVE area, see xstate.c
+  REG_MXCSR = REGISTERS_COUNT,
+  REG_ST0,
+  REG_XMM0 = REG_ST0 + 8,
+  REG_YMM0 = REG_XMM0 + 32,
+  REG_ZMM0 = REG_YMM0 + 32,
+  REG_K0 = REG_ZMM0 + 32,
+  XREGISTERS_END = REG_K0 + 8
 };
 
 #define ENUMERATE_TOKENS                                                       \
@@ -44,6 +52,8 @@ enum Register : uint8_t {
   __ENUMERATE_TOKEN(TOK_DIV)                                                   \
   __ENUMERATE_TOKEN(TOK_LPAREN)                                                \
   __ENUMERATE_TOKEN(TOK_RPAREN)                                                \
+  __ENUMERATE_TOKEN(TOK_LBRACKET)                                              \
+  __ENUMERATE_TOKEN(TOK_RBRACKET)                                              \
   __ENUMERATE_TOKEN(TOK_EOL)                                                   \
   __ENUMERATE_TOKEN(TOK_INVALID)
 
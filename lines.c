@@ -0,0 +1,1230 @@
+#include "lines.h"
+#include "maps.h"
+#include <assert.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the little of DWARF 4/5 that line tables need
+#define DW_AT_stmt_list 0x10
+#define DW_AT_low_pc 0x11
+#define DW_AT_high_pc 0x12
+#define DW_AT_comp_dir 0x1b
+#define DW_AT_ranges 0x55
+#define DW_AT_str_offsets_base 0x72
+#define DW_AT_addr_base 0x73
+#define DW_AT_rnglists_base 0x74
+
+#define DW_UT_compile 0x01
+#define DW_UT_partial 0x03
+#define DW_UT_skeleton 0x04
+#define DW_UT_split_compile 0x05
+
+enum Form : uint8_t {
+  DW_FORM_addr = 0x01,
+  DW_FORM_block2 = 0x03,
+  DW_FORM_block4,
+  DW_FORM_data2,
+  DW_FORM_data4,
+  DW_FORM_data8,
+  DW_FORM_string,
+  DW_FORM_block,
+  DW_FORM_block1,
+  DW_FORM_data1,
+  DW_FORM_flag,
+  DW_FORM_sdata,
+  DW_FORM_strp,
+  DW_FORM_udata,
+  DW_FORM_ref_addr,
+  DW_FORM_ref1,
+  DW_FORM_ref2,
+  DW_FORM_ref4,
+  DW_FORM_ref8,
+  DW_FORM_ref_udata,
+  DW_FORM_indirect,
+  DW_FORM_sec_offset,
+  DW_FORM_exprloc,
+  DW_FORM_flag_present,
+  DW_FORM_strx,
+  DW_FORM_addrx,
+  DW_FORM_ref_sup4,
+  DW_FORM_strp_sup,
+  DW_FORM_data16,
+  DW_FORM_line_strp,
+  DW_FORM_ref_sig8,
+  DW_FORM_implicit_const,
+  DW_FORM_loclistx,
+  DW_FORM_rnglistx,
+  DW_FORM_ref_sup8,
+  DW_FORM_strx1,
+  DW_FORM_strx2,
+  DW_FORM_strx3,
+  DW_FORM_strx4,
+  DW_FORM_addrx1,
+  DW_FORM_addrx2,
+  DW_FORM_addrx3,
+  DW_FORM_addrx4,
+};
+
+#define DW_LNS_copy 1
+#define DW_LNS_advance_pc 2
+#define DW_LNS_advance_line 3
+#define DW_LNS_set_file 4
+#define DW_LNS_negate_stmt 6
+#define DW_LNS_const_add_pc 8
+#define DW_LNS_fixed_advance_pc 9
+
+#define DW_LNE_end_sequence 1
+#define DW_LNE_set_address 2
+
+#define DW_RLE_end_of_list 0
+#define DW_RLE_base_addressx 1
+#define DW_RLE_startx_endx 2
+#define DW_RLE_startx_length 3
+#define DW_RLE_offset_pair 4
+#define DW_RLE_base_address 5
+#define DW_RLE_start_end 6
+#define DW_RLE_start_length 7
+
+#define DW_LNCT_path 1
+#define DW_LNCT_directory_index 2
+
+#define NO_OFFSET UINT64_MAX
+
+enum Section : uint8_t {
+  SEC_INFO,
+  SEC_ABBREV,
+  SEC_ARANGES,
+  SEC_LINE,
+  SEC_STR,
+  SEC_LINE_STR,
+  SEC_ADDR,
+  SEC_STR_OFFSETS,
+  SEC_RANGES,
+  SEC_RNGLISTS,
+  SECTIONS_COUNT
+};
+
+static const char *section_names[SECTIONS_COUNT] = {
+    ".debug_info",    ".debug_abbrev",      ".debug_aranges",
+    ".debug_line",    ".debug_str",         ".debug_line_str",
+    ".debug_addr",    ".debug_str_offsets", ".debug_ranges",
+    ".debug_rnglists",
+};
+
+// reads past the end come back as zeros rather than faults
+struct Cursor {
+  const uint8_t *at;
+  const uint8_t *end;
+};
+
+// what decoding a form depends on
+struct Format {
+  uint16_t version;
+  uint8_t offset_size;
+  uint8_t address_size;
+};
+
+struct FormValue {
+  uint64_t number;
+  const char *string;
+};
+
+// an attribute that may need a base from later on in the same DIE
+struct Attribute {
+  uint64_t form;
+  struct FormValue value;
+};
+
+struct Row {
+  uint64_t address;
+  uint32_t file;
+  uint32_t line;
+  bool is_stmt;
+  bool is_end;
+};
+
+// one per compilation unit, filled in as it gets touched: the CU DIE on the
+// first lookup, the line program's file table when a file is looked up, and
+// the rows when an address is
+struct Unit {
+  uint64_t info_offset;
+  bool is_parsed;
+  bool has_aranges;
+  uint64_t line_offset;
+  const char *comp_dir;
+  uint64_t low_pc;
+  uint64_t high_pc;
+  // where DW_AT_ranges points in .debug_ranges, or .debug_rnglists from
+  // version 5 on
+  uint64_t ranges_offset;
+  uint16_t version;
+  uint8_t address_size;
+  uint64_t addr_base;
+
+  bool has_files;
+  char **files;
+  size_t files_count;
+
+  bool has_rows;
+  struct Row *rows;
+  size_t rows_count;
+};
+
+struct Range {
+  uint64_t start;
+  uint64_t end;
+  struct Unit *unit;
+};
+
+struct SourceFile {
+  char *path;
+  char *data;
+  size_t size;
+  uint32_t *starts;
+  uint32_t lines_count;
+};
+
+static struct {
+  bool is_loaded;
+  const uint8_t *elf;
+  size_t elf_size;
+  struct Cursor sections[SECTIONS_COUNT];
+  // runtime address - link time address
+  uint64_t bias;
+
+  struct Unit *units;
+  size_t units_count;
+  struct Range *ranges;
+  size_t ranges_count;
+
+  struct SourceFile *sources;
+  size_t sources_count;
+} dwarf;
+
+static uint64_t read_fixed(struct Cursor *c, size_t size) {
+  uint64_t value = 0;
+  if ((size_t)(c->end - c->at) < size) {
+    c->at = c->end;
+    return 0;
+  }
+  memcpy(&value, c->at, size);
+  c->at += size;
+  return value;
+}
+
+static void skip(struct Cursor *c, uint64_t size) {
+  c->at = size < (uint64_t)(c->end - c->at) ? c->at + size : c->end;
+}
+
+static uint64_t read_uleb(struct Cursor *c) {
+  uint64_t value = 0;
+  unsigned shift = 0;
+  while (c->at < c->end) {
+    uint8_t byte = *c->at++;
+    if (shift < 64)
+      value |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+    if (!(byte & 0x80))
+      break;
+  }
+  return value;
+}
+
+static int64_t read_sleb(struct Cursor *c) {
+  uint64_t value = 0;
+  unsigned shift = 0;
+  uint8_t byte = 0;
+  while (c->at < c->end) {
+    byte = *c->at++;
+    if (shift < 64)
+      value |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+    if (!(byte & 0x80))
+      break;
+  }
+  if (shift < 64 && (byte & 0x40))
+    value |= ~0ull << shift;
+  return value;
+}
+
+static const char *read_cstr(struct Cursor *c) {
+  const char *str = (const char *)c->at;
+  const uint8_t *nul = memchr(c->at, '\0', c->end - c->at);
+  if (!nul) {
+    c->at = c->end;
+    return NULL;
+  }
+  c->at = nul + 1;
+  return str;
+}
+
+// 32 or 64 bit DWARF, by the initial length
+static uint64_t read_length(struct Cursor *c, uint8_t *offset_size) {
+  uint64_t length = read_fixed(c, 4);
+  *offset_size = 4;
+  if (length == 0xffffffff) {
+    length = read_fixed(c, 8);
+    *offset_size = 8;
+  }
+  return length;
+}
+
+static const char *section_string(enum Section section, uint64_t offset) {
+  struct Cursor c = dwarf.sections[section];
+  if (offset >= (uint64_t)(c.end - c.at))
+    return NULL;
+  c.at += offset;
+  return read_cstr(&c);
+}
+
+static struct FormValue read_form(struct Cursor *c, uint64_t form,
+                                  const struct Format *format,
+                                  int64_t implicit_const) {
+  struct FormValue value = {0};
+
+  switch (form) {
+  case DW_FORM_addr:
+    value.number = read_fixed(c, format->address_size);
+    break;
+  case DW_FORM_data1:
+  case DW_FORM_ref1:
+  case DW_FORM_flag:
+  case DW_FORM_strx1:
+  case DW_FORM_addrx1:
+    value.number = read_fixed(c, 1);
+    break;
+  case DW_FORM_data2:
+  case DW_FORM_ref2:
+  case DW_FORM_strx2:
+  case DW_FORM_addrx2:
+    value.number = read_fixed(c, 2);
+    break;
+  case DW_FORM_strx3:
+  case DW_FORM_addrx3:
+    value.number = read_fixed(c, 3);
+    break;
+  case DW_FORM_data4:
+  case DW_FORM_ref4:
+  case DW_FORM_ref_sup4:
+  case DW_FORM_strx4:
+  case DW_FORM_addrx4:
+    value.number = read_fixed(c, 4);
+    break;
+  case DW_FORM_data8:
+  case DW_FORM_ref8:
+  case DW_FORM_ref_sig8:
+  case DW_FORM_ref_sup8:
+    value.number = read_fixed(c, 8);
+    break;
+  case DW_FORM_data16:
+    skip(c, 16);
+    break;
+  case DW_FORM_sdata:
+    value.number = read_sleb(c);
+    break;
+  case DW_FORM_udata:
+  case DW_FORM_ref_udata:
+  case DW_FORM_strx:
+  case DW_FORM_addrx:
+  case DW_FORM_loclistx:
+  case DW_FORM_rnglistx:
+    value.number = read_uleb(c);
+    break;
+  case DW_FORM_strp:
+    value.number = read_fixed(c, format->offset_size);
+    value.string = section_string(SEC_STR, value.number);
+    break;
+  case DW_FORM_line_strp:
+    value.number = read_fixed(c, format->offset_size);
+    value.string = section_string(SEC_LINE_STR, value.number);
+    break;
+  case DW_FORM_sec_offset:
+  case DW_FORM_strp_sup:
+    value.number = read_fixed(c, format->offset_size);
+    break;
+  case DW_FORM_ref_addr:
+    value.number = read_fixed(c, format->version <= 2 ? format->address_size
+                                                      : format->offset_size);
+    break;
+  case DW_FORM_string:
+    value.string = read_cstr(c);
+    break;
+  case DW_FORM_block1:
+    skip(c, read_fixed(c, 1));
+    break;
+  case DW_FORM_block2:
+    skip(c, read_fixed(c, 2));
+    break;
+  case DW_FORM_block4:
+    skip(c, read_fixed(c, 4));
+    break;
+  case DW_FORM_block:
+  case DW_FORM_exprloc:
+    skip(c, read_uleb(c));
+    break;
+  case DW_FORM_flag_present:
+    value.number = 1;
+    break;
+  case DW_FORM_implicit_const:
+    value.number = implicit_const;
+    break;
+  case DW_FORM_indirect:
+    return read_form(c, read_uleb(c), format, implicit_const);
+  default:
+    // no telling how long it is, so nothing after it can be read either
+    c->at = c->end;
+    break;
+  }
+
+  return value;
+}
+
+static bool find_sections(void) {
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)dwarf.elf;
+  if (dwarf.elf_size < sizeof(*ehdr) || memcmp(ehdr, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_ident[EI_CLASS] != ELFCLASS64 || ehdr->e_shstrndx >= ehdr->e_shnum ||
+      ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > dwarf.elf_size)
+    return false;
+
+  const Elf64_Shdr *shdrs = (const Elf64_Shdr *)(dwarf.elf + ehdr->e_shoff);
+  const Elf64_Shdr *shstrtab = &shdrs[ehdr->e_shstrndx];
+
+  for (size_t i = 0; i < ehdr->e_shnum; i++) {
+    // compressed debug info would have to be inflated up front
+    if (shdrs[i].sh_type == SHT_NOBITS || shdrs[i].sh_flags & SHF_COMPRESSED ||
+        shdrs[i].sh_offset + shdrs[i].sh_size > dwarf.elf_size ||
+        shdrs[i].sh_name >= shstrtab->sh_size)
+      continue;
+
+    const char *name =
+        (const char *)dwarf.elf + shstrtab->sh_offset + shdrs[i].sh_name;
+    for (size_t j = 0; j < SECTIONS_COUNT; j++) {
+      if (strcmp(name, section_names[j]) == 0) {
+        dwarf.sections[j].at = dwarf.elf + shdrs[i].sh_offset;
+        dwarf.sections[j].end = dwarf.sections[j].at + shdrs[i].sh_size;
+      }
+    }
+  }
+
+  return dwarf.sections[SEC_INFO].at && dwarf.sections[SEC_LINE].at;
+}
+
+// PIEs get loaded wherever, everything else where it was linked
+static void find_bias(int pid, const char *exe) {
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)dwarf.elf;
+  if (ehdr->e_type != ET_DYN ||
+      ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) > dwarf.elf_size)
+    return;
+
+  const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(dwarf.elf + ehdr->e_phoff);
+  uint64_t first_vaddr = UINT64_MAX;
+  for (size_t i = 0; i < ehdr->e_phnum; i++) {
+    if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_vaddr < first_vaddr)
+      first_vaddr = phdrs[i].p_vaddr;
+  }
+
+  char path[PATH_MAX] = {0};
+  if (readlink(exe, path, sizeof(path) - 1) == -1)
+    return;
+
+  size_t count;
+  const struct Mapping *mappings = get_mappings(pid, &count);
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(mappings[i].path, path) == 0) {
+      dwarf.bias = mappings[i].start - (first_vaddr & ~0xfffull);
+      return;
+    }
+  }
+}
+
+// only the unit headers, so finding a unit by offset is a binary search
+static void find_units(void) {
+  struct Cursor c = dwarf.sections[SEC_INFO];
+  const uint8_t *start = c.at;
+  size_t capacity = 0;
+
+  while (c.at < c.end) {
+    uint64_t offset = c.at - start;
+    uint8_t offset_size;
+    uint64_t length = read_length(&c, &offset_size);
+    if (!length)
+      break;
+    skip(&c, length);
+
+    if (dwarf.units_count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      dwarf.units = realloc(dwarf.units, capacity * sizeof(struct Unit));
+      assert(dwarf.units);
+    }
+    dwarf.units[dwarf.units_count++] =
+        (struct Unit){.info_offset = offset,
+                      .line_offset = NO_OFFSET,
+                      .ranges_offset = NO_OFFSET};
+  }
+}
+
+static struct Unit *unit_at_offset(uint64_t info_offset) {
+  size_t lo = 0, hi = dwarf.units_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (dwarf.units[mid].info_offset < info_offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < dwarf.units_count && dwarf.units[lo].info_offset == info_offset)
+    return &dwarf.units[lo];
+  return NULL;
+}
+
+static bool is_addrx(uint64_t form) {
+  return form == DW_FORM_addrx ||
+         (form >= DW_FORM_addrx1 && form <= DW_FORM_addrx4);
+}
+
+static bool is_strx(uint64_t form) {
+  return form == DW_FORM_strx ||
+         (form >= DW_FORM_strx1 && form <= DW_FORM_strx4);
+}
+
+// an entry of the unit's slice of .debug_addr
+static uint64_t read_addrx(const struct Unit *unit, uint64_t index) {
+  struct Cursor c = dwarf.sections[SEC_ADDR];
+  skip(&c, unit->addr_base + index * unit->address_size);
+  return read_fixed(&c, unit->address_size);
+}
+
+static uint64_t read_address(const struct Unit *unit,
+                             const struct Attribute *attribute) {
+  return is_addrx(attribute->form) ? read_addrx(unit, attribute->value.number)
+                                   : attribute->value.number;
+}
+
+// an offset out of the table that starts at base, as strx and rnglistx use
+static uint64_t read_offset_entry(enum Section section, uint64_t base,
+                                  uint8_t offset_size, uint64_t index) {
+  struct Cursor c = dwarf.sections[section];
+  skip(&c, base + index * offset_size);
+  if ((uint64_t)(c.end - c.at) < offset_size)
+    return NO_OFFSET;
+  return read_fixed(&c, offset_size);
+}
+
+// just the compile unit DIE, for where its line program is
+static void parse_unit(struct Unit *unit) {
+  if (unit->is_parsed)
+    return;
+  unit->is_parsed = true;
+
+  struct Cursor c = dwarf.sections[SEC_INFO];
+  skip(&c, unit->info_offset);
+
+  struct Format format;
+  uint64_t length = read_length(&c, &format.offset_size);
+  if (length < (uint64_t)(c.end - c.at))
+    c.end = c.at + length;
+  format.version = read_fixed(&c, 2);
+
+  uint64_t abbrev_offset;
+  if (format.version >= 5) {
+    uint8_t unit_type = read_fixed(&c, 1);
+    format.address_size = read_fixed(&c, 1);
+    abbrev_offset = read_fixed(&c, format.offset_size);
+    if (unit_type == DW_UT_skeleton || unit_type == DW_UT_split_compile)
+      skip(&c, 8);
+    else if (unit_type != DW_UT_compile && unit_type != DW_UT_partial)
+      return;
+  } else {
+    abbrev_offset = read_fixed(&c, format.offset_size);
+    format.address_size = read_fixed(&c, 1);
+  }
+
+  unit->version = format.version;
+  unit->address_size = format.address_size;
+
+  // the bases default to just past the header of the unit's contribution
+  uint64_t header_size = format.offset_size == 8 ? 12 : 4;
+  unit->addr_base = header_size + 4;
+  uint64_t str_offsets_base = header_size + 4;
+  uint64_t rnglists_base = header_size + 8;
+
+  uint64_t code = read_uleb(&c);
+
+  struct Cursor abbrev = dwarf.sections[SEC_ABBREV];
+  skip(&abbrev, abbrev_offset);
+  while (abbrev.at < abbrev.end) {
+    uint64_t abbrev_code = read_uleb(&abbrev);
+    if (!abbrev_code)
+      return;
+    read_uleb(&abbrev);
+    skip(&abbrev, 1);
+    if (abbrev_code == code)
+      break;
+
+    while (abbrev.at < abbrev.end) {
+      uint64_t attribute = read_uleb(&abbrev);
+      uint64_t form = read_uleb(&abbrev);
+      if (form == DW_FORM_implicit_const)
+        read_sleb(&abbrev);
+      if (!attribute && !form)
+        break;
+    }
+  }
+
+  struct Attribute low_pc = {0}, high_pc = {0}, comp_dir = {0}, ranges = {0};
+  while (abbrev.at < abbrev.end) {
+    uint64_t attribute = read_uleb(&abbrev);
+    uint64_t form = read_uleb(&abbrev);
+    int64_t implicit_const =
+        form == DW_FORM_implicit_const ? read_sleb(&abbrev) : 0;
+    if (!attribute && !form)
+      break;
+
+    struct Attribute value = {form,
+                              read_form(&c, form, &format, implicit_const)};
+    switch (attribute) {
+    case DW_AT_stmt_list:
+      unit->line_offset = value.value.number;
+      break;
+    case DW_AT_low_pc:
+      low_pc = value;
+      break;
+    case DW_AT_high_pc:
+      high_pc = value;
+      break;
+    case DW_AT_comp_dir:
+      comp_dir = value;
+      break;
+    case DW_AT_ranges:
+      ranges = value;
+      break;
+    case DW_AT_addr_base:
+      unit->addr_base = value.value.number;
+      break;
+    case DW_AT_str_offsets_base:
+      str_offsets_base = value.value.number;
+      break;
+    case DW_AT_rnglists_base:
+      rnglists_base = value.value.number;
+      break;
+    }
+  }
+
+  unit->low_pc = read_address(unit, &low_pc);
+  // an address, or from DWARF 4 on usually the length
+  if (high_pc.form == DW_FORM_addr || is_addrx(high_pc.form))
+    unit->high_pc = read_address(unit, &high_pc);
+  else if (high_pc.form)
+    unit->high_pc = unit->low_pc + high_pc.value.number;
+
+  unit->comp_dir = comp_dir.value.string;
+  if (is_strx(comp_dir.form)) {
+    uint64_t offset =
+        read_offset_entry(SEC_STR_OFFSETS, str_offsets_base,
+                          format.offset_size, comp_dir.value.number);
+    if (offset != NO_OFFSET)
+      unit->comp_dir = section_string(SEC_STR, offset);
+  }
+
+  // rnglistx offsets are from the base, not the start of the section
+  if (ranges.form == DW_FORM_rnglistx) {
+    uint64_t offset = read_offset_entry(SEC_RNGLISTS, rnglists_base,
+                                        format.offset_size,
+                                        ranges.value.number);
+    if (offset != NO_OFFSET)
+      unit->ranges_offset = rnglists_base + offset;
+  } else if (ranges.form) {
+    unit->ranges_offset = ranges.value.number;
+  }
+}
+
+static int compare_ranges(const void *a, const void *b) {
+  const struct Range *lhs = a, *rhs = b;
+  return (lhs->start > rhs->start) - (lhs->start < rhs->start);
+}
+
+static void push_range(uint64_t start, uint64_t end, struct Unit *unit,
+                       size_t *capacity) {
+  if (dwarf.ranges_count == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 64;
+    dwarf.ranges = realloc(dwarf.ranges, *capacity * sizeof(struct Range));
+    assert(dwarf.ranges);
+  }
+  dwarf.ranges[dwarf.ranges_count++] = (struct Range){start, end, unit};
+}
+
+// DW_AT_ranges for a unit whose code isn't in one piece, low_pc/high_pc
+// otherwise
+static void push_unit_ranges(struct Unit *unit, size_t *capacity) {
+  if (unit->ranges_offset == NO_OFFSET) {
+    if (unit->low_pc && unit->high_pc > unit->low_pc)
+      push_range(unit->low_pc, unit->high_pc, unit, capacity);
+    return;
+  }
+
+  uint8_t size = unit->address_size;
+  uint64_t base = unit->low_pc;
+  struct Cursor c =
+      dwarf.sections[unit->version >= 5 ? SEC_RNGLISTS : SEC_RANGES];
+  skip(&c, unit->ranges_offset);
+
+  while (c.at < c.end) {
+    uint64_t start, end;
+
+    if (unit->version < 5) {
+      start = read_fixed(&c, size);
+      end = read_fixed(&c, size);
+      if (!start && !end)
+        return;
+      // a base address selection entry
+      if (start == (size == 8 ? UINT64_MAX : UINT32_MAX)) {
+        base = end;
+        continue;
+      }
+      start += base;
+      end += base;
+    } else {
+      switch (read_fixed(&c, 1)) {
+      case DW_RLE_base_addressx:
+        base = read_addrx(unit, read_uleb(&c));
+        continue;
+      case DW_RLE_startx_endx:
+        start = read_addrx(unit, read_uleb(&c));
+        end = read_addrx(unit, read_uleb(&c));
+        break;
+      case DW_RLE_startx_length:
+        start = read_addrx(unit, read_uleb(&c));
+        end = start + read_uleb(&c);
+        break;
+      case DW_RLE_offset_pair:
+        start = base + read_uleb(&c);
+        end = base + read_uleb(&c);
+        break;
+      case DW_RLE_base_address:
+        base = read_fixed(&c, size);
+        continue;
+      case DW_RLE_start_end:
+        start = read_fixed(&c, size);
+        end = read_fixed(&c, size);
+        break;
+      case DW_RLE_start_length:
+        start = read_fixed(&c, size);
+        end = start + read_uleb(&c);
+        break;
+      default:
+        // DW_RLE_end_of_list, or nothing past it can be read
+        return;
+      }
+    }
+
+    if (start && end > start)
+      push_range(start, end, unit, capacity);
+  }
+}
+
+// .debug_aranges says which unit covers an address without reading the
+// units themselves. Only the units it leaves out get their CU DIE read
+static void find_ranges(void) {
+  size_t capacity = 0;
+  struct Cursor c = dwarf.sections[SEC_ARANGES];
+
+  while (c.at && c.at < c.end) {
+    const uint8_t *set_start = c.at;
+    uint8_t offset_size;
+    uint64_t length = read_length(&c, &offset_size);
+    if (!length)
+      break;
+    const uint8_t *set_end = c.at + length;
+
+    skip(&c, 2);
+    struct Unit *unit = unit_at_offset(read_fixed(&c, offset_size));
+    uint8_t address_size = read_fixed(&c, 1);
+    skip(&c, 1);
+
+    // tuples are aligned to their own size from the start of the set
+    size_t tuple_size = 2 * address_size;
+    if (tuple_size && (c.at - set_start) % tuple_size)
+      skip(&c, tuple_size - (c.at - set_start) % tuple_size);
+
+    while (unit && tuple_size && c.at < set_end) {
+      uint64_t start = read_fixed(&c, address_size);
+      uint64_t size = read_fixed(&c, address_size);
+      if (!start && !size)
+        break;
+      // ranges of functions the linker dropped point at 0
+      if (start && size) {
+        push_range(start, start + size, unit, &capacity);
+        unit->has_aranges = true;
+      }
+    }
+
+    c.at = set_end;
+  }
+
+  // clang leaves .debug_aranges out unless asked, and gcc the units without
+  // code
+  for (size_t i = 0; i < dwarf.units_count; i++) {
+    struct Unit *unit = &dwarf.units[i];
+    if (unit->has_aranges)
+      continue;
+    parse_unit(unit);
+    push_unit_ranges(unit, &capacity);
+  }
+
+  qsort(dwarf.ranges, dwarf.ranges_count, sizeof(struct Range),
+        compare_ranges);
+}
+
+static void load(int pid) {
+  dwarf.is_loaded = true;
+
+  char exe[64];
+  snprintf(exe, sizeof(exe), "/proc/%d/exe", pid);
+
+  int fd = open(exe, O_RDONLY);
+  if (fd == -1)
+    return;
+
+  // the whole file, but only what gets looked at is ever paged in
+  struct stat st;
+  fstat(fd, &st);
+  void *elf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (elf == MAP_FAILED)
+    return;
+
+  dwarf.elf = elf;
+  dwarf.elf_size = st.st_size;
+
+  if (!find_sections())
+    return;
+
+  find_bias(pid, exe);
+  find_units();
+  find_ranges();
+}
+
+static struct Unit *unit_at_address(uint64_t address) {
+  size_t lo = 0, hi = dwarf.ranges_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (dwarf.ranges[mid].start <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0 || address >= dwarf.ranges[lo - 1].end)
+    return NULL;
+  return dwarf.ranges[lo - 1].unit;
+}
+
+static char *join_path(const char *comp_dir, const char *dir,
+                       const char *name) {
+  if (!name)
+    return NULL;
+
+  char path[PATH_MAX];
+  if (name[0] == '/' || !dir || !dir[0])
+    snprintf(path, sizeof(path), "%s", name);
+  else if (dir[0] == '/' || !comp_dir)
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+  else
+    snprintf(path, sizeof(path), "%s/%s/%s", comp_dir, dir, name);
+  return strdup(path);
+}
+
+struct LineHeader {
+  struct Format format;
+  uint8_t min_instruction_length;
+  bool default_is_stmt;
+  int8_t line_base;
+  uint8_t line_range;
+  uint8_t opcode_base;
+  const uint8_t *opcode_lengths;
+  struct Cursor program;
+};
+
+// DWARF 5 directory and file tables describe their own layout
+static void read_entries(struct Cursor *c, const struct Format *format,
+                         const char **paths, uint64_t *dirs, size_t count,
+                         const uint8_t *layout, size_t layout_count) {
+  for (size_t i = 0; i < count; i++) {
+    struct Cursor fields = {layout, dwarf.sections[SEC_LINE].end};
+    for (size_t j = 0; j < layout_count; j++) {
+      uint64_t content = read_uleb(&fields);
+      uint64_t form = read_uleb(&fields);
+      struct FormValue value = read_form(c, form, format, 0);
+      if (content == DW_LNCT_path)
+        paths[i] = value.string;
+      else if (content == DW_LNCT_directory_index && dirs)
+        dirs[i] = value.number;
+    }
+  }
+}
+
+static bool read_line_header(struct Unit *unit, struct LineHeader *header) {
+  parse_unit(unit);
+  if (unit->line_offset == NO_OFFSET)
+    return false;
+
+  struct Cursor c = dwarf.sections[SEC_LINE];
+  skip(&c, unit->line_offset);
+
+  struct Format *format = &header->format;
+  uint64_t length = read_length(&c, &format->offset_size);
+  if (length < (uint64_t)(c.end - c.at))
+    c.end = c.at + length;
+  format->version = read_fixed(&c, 2);
+  format->address_size = 8;
+  if (format->version < 2 || format->version > 5)
+    return false;
+
+  if (format->version >= 5) {
+    format->address_size = read_fixed(&c, 1);
+    skip(&c, 1);
+  }
+
+  uint64_t header_length = read_fixed(&c, format->offset_size);
+  header->program = (struct Cursor){c.at + header_length, c.end};
+  if (header->program.at > c.end)
+    return false;
+
+  header->min_instruction_length = read_fixed(&c, 1);
+  if (format->version >= 4)
+    skip(&c, 1);
+  header->default_is_stmt = read_fixed(&c, 1);
+  header->line_base = read_fixed(&c, 1);
+  header->line_range = read_fixed(&c, 1);
+  header->opcode_base = read_fixed(&c, 1);
+  header->opcode_lengths = c.at;
+  skip(&c, header->opcode_base ? header->opcode_base - 1 : 0);
+  if (!header->line_range)
+    return false;
+
+  if (unit->has_files)
+    return true;
+  unit->has_files = true;
+
+  if (format->version >= 5) {
+    uint8_t dir_layout_count = read_fixed(&c, 1);
+    const uint8_t *dir_layout = c.at;
+    for (size_t i = 0; i < 2u * dir_layout_count; i++)
+      read_uleb(&c);
+    size_t dirs_count = read_uleb(&c);
+    const char **dirs = calloc(dirs_count + 1, sizeof(char *));
+    read_entries(&c, format, dirs, NULL, dirs_count, dir_layout,
+                 dir_layout_count);
+
+    uint8_t file_layout_count = read_fixed(&c, 1);
+    const uint8_t *file_layout = c.at;
+    for (size_t i = 0; i < 2u * file_layout_count; i++)
+      read_uleb(&c);
+    size_t files_count = read_uleb(&c);
+    const char **names = calloc(files_count + 1, sizeof(char *));
+    uint64_t *file_dirs = calloc(files_count + 1, sizeof(uint64_t));
+    read_entries(&c, format, names, file_dirs, files_count, file_layout,
+                 file_layout_count);
+
+    // directory 0 is the compilation directory itself
+    unit->files = calloc(files_count + 1, sizeof(char *));
+    unit->files_count = files_count;
+    for (size_t i = 0; i < files_count; i++) {
+      const char *dir = file_dirs[i] < dirs_count ? dirs[file_dirs[i]] : NULL;
+      unit->files[i] = join_path(dirs_count ? dirs[0] : unit->comp_dir, dir,
+                                 names[i]);
+    }
+
+    free(dirs);
+    free(names);
+    free(file_dirs);
+    return true;
+  }
+
+  // DWARF 4 and older count from 1, with directory 0 being the comp dir
+  const char **dirs = NULL;
+  size_t dirs_count = 1;
+  for (const char *dir; (dir = read_cstr(&c)) && dir[0];) {
+    dirs = realloc(dirs, (dirs_count + 1) * sizeof(char *));
+    dirs[dirs_count++] = dir;
+  }
+
+  size_t capacity = 1;
+  unit->files = calloc(capacity, sizeof(char *));
+  unit->files_count = 1;
+  for (const char *name; (name = read_cstr(&c)) && name[0];) {
+    uint64_t dir = read_uleb(&c);
+    read_uleb(&c);
+    read_uleb(&c);
+
+    if (unit->files_count == capacity) {
+      capacity *= 2;
+      unit->files = realloc(unit->files, capacity * sizeof(char *));
+    }
+    unit->files[unit->files_count++] =
+        join_path(unit->comp_dir,
+                  dir && dir < dirs_count ? dirs[dir] : unit->comp_dir, name);
+  }
+
+  free(dirs);
+  return true;
+}
+
+static int compare_rows(const void *a, const void *b) {
+  const struct Row *lhs = a, *rhs = b;
+  if (lhs->address != rhs->address)
+    return (lhs->address > rhs->address) - (lhs->address < rhs->address);
+  // a sequence ending where the next one starts sorts before it
+  return rhs->is_end - lhs->is_end;
+}
+
+static bool read_rows(struct Unit *unit) {
+  if (unit->has_rows)
+    return unit->rows_count > 0;
+  unit->has_rows = true;
+
+  struct LineHeader header;
+  if (!read_line_header(unit, &header))
+    return false;
+
+  struct Cursor c = header.program;
+  size_t capacity = 0;
+
+  struct Row state = {.file = 1, .line = 1, .is_stmt = header.default_is_stmt};
+  // sequences of code the linker dropped start at 0 (or -1)
+  bool is_dead = false;
+
+#define EMIT_ROW()                                                             \
+  do {                                                                         \
+    if (!is_dead) {                                                            \
+      if (unit->rows_count == capacity) {                                      \
+        capacity = capacity ? capacity * 2 : 256;                              \
+        unit->rows = realloc(unit->rows, capacity * sizeof(struct Row));       \
+        assert(unit->rows);                                                    \
+      }                                                                        \
+      unit->rows[unit->rows_count++] = state;                                  \
+    }                                                                          \
+  } while (0)
+
+  while (c.at < c.end) {
+    uint8_t opcode = read_fixed(&c, 1);
+
+    if (opcode >= header.opcode_base) {
+      uint8_t adjusted = opcode - header.opcode_base;
+      state.address +=
+          adjusted / header.line_range * header.min_instruction_length;
+      state.line += header.line_base + adjusted % header.line_range;
+      EMIT_ROW();
+      continue;
+    }
+
+    switch (opcode) {
+    case 0: {
+      uint64_t length = read_uleb(&c);
+      const uint8_t *next = c.end - c.at > (ptrdiff_t)length ? c.at + length
+                                                             : c.end;
+      uint8_t extended = read_fixed(&c, 1);
+      if (extended == DW_LNE_end_sequence) {
+        state.is_end = true;
+        EMIT_ROW();
+        state = (struct Row){.file = 1, .line = 1,
+                             .is_stmt = header.default_is_stmt};
+        is_dead = false;
+      } else if (extended == DW_LNE_set_address) {
+        state.address = read_fixed(&c, length - 1);
+        is_dead = state.address == 0 || state.address == UINT64_MAX;
+      }
+      c.at = next;
+      break;
+    }
+    case DW_LNS_copy:
+      EMIT_ROW();
+      break;
+    case DW_LNS_advance_pc:
+      state.address += read_uleb(&c) * header.min_instruction_length;
+      break;
+    case DW_LNS_advance_line:
+      state.line += read_sleb(&c);
+      break;
+    case DW_LNS_set_file:
+      state.file = read_uleb(&c);
+      break;
+    case DW_LNS_negate_stmt:
+      state.is_stmt = !state.is_stmt;
+      break;
+    case DW_LNS_const_add_pc:
+      state.address += (255 - header.opcode_base) / header.line_range *
+                       header.min_instruction_length;
+      break;
+    case DW_LNS_fixed_advance_pc:
+      state.address += read_fixed(&c, 2);
+      break;
+    default:
+      // everything else only touches registers we don't track
+      for (size_t i = 0; i < header.opcode_lengths[opcode - 1]; i++)
+        read_uleb(&c);
+      break;
+    }
+  }
+
+#undef EMIT_ROW
+
+  qsort(unit->rows, unit->rows_count, sizeof(struct Row), compare_rows);
+  return unit->rows_count > 0;
+}
+
+bool find_line(int pid, uint64_t address, struct SourceLine *line) {
+  if (!dwarf.is_loaded)
+    load(pid);
+
+  uint64_t link_address = address - dwarf.bias;
+  struct Unit *unit = unit_at_address(link_address);
+  if (!unit || !read_rows(unit))
+    return false;
+
+  size_t lo = 0, hi = unit->rows_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (unit->rows[mid].address <= link_address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return false;
+
+  const struct Row *row = &unit->rows[lo - 1];
+  if (row->is_end || row->file >= unit->files_count || !unit->files[row->file])
+    return false;
+
+  *line = (struct SourceLine){unit->files[row->file], row->line,
+                              row->address + dwarf.bias, row->is_stmt};
+  return true;
+}
+
+// a bare file name matches any directory, a longer one on whole components
+static bool is_same_file(const char *path, const char *file) {
+  size_t path_len = strlen(path), file_len = strlen(file);
+  if (file_len > path_len)
+    return false;
+  const char *tail = path + path_len - file_len;
+  return strcmp(tail, file) == 0 && (tail == path || tail[-1] == '/');
+}
+
+// the first statement of the line, or of the next line that has code
+bool find_line_address(int pid, const char *file, uint32_t line,
+                       uint64_t *address) {
+  if (!dwarf.is_loaded)
+    load(pid);
+
+  const struct Row *best = NULL;
+
+  for (size_t i = 0; i < dwarf.units_count; i++) {
+    struct Unit *unit = &dwarf.units[i];
+    struct LineHeader header;
+    if (!unit->has_files && !read_line_header(unit, &header))
+      continue;
+
+    for (size_t f = 0; f < unit->files_count; f++) {
+      if (!unit->files[f] || !is_same_file(unit->files[f], file))
+        continue;
+      if (!read_rows(unit))
+        break;
+
+      for (size_t r = 0; r < unit->rows_count; r++) {
+        const struct Row *row = &unit->rows[r];
+        if (row->file != f || !row->is_stmt || row->is_end || row->line < line)
+          continue;
+        if (!best || row->line < best->line ||
+            (row->line == best->line && row->address < best->address))
+          best = row;
+      }
+    }
+  }
+
+  if (!best)
+    return false;
+
+  *address = best->address + dwarf.bias;
+  return true;
+}
+
+static struct SourceFile *open_source(const char *path) {
+  for (size_t i = 0; i < dwarf.sources_count; i++) {
+    if (strcmp(dwarf.sources[i].path, path) == 0)
+      return &dwarf.sources[i];
+  }
+
+  dwarf.sources = realloc(dwarf.sources,
+                          (dwarf.sources_count + 1) * sizeof(struct SourceFile));
+  assert(dwarf.sources);
+  struct SourceFile *source = &dwarf.sources[dwarf.sources_count++];
+  *source = (struct SourceFile){.path = strdup(path)};
+
+  // remembered as missing, so the view doesn't retry on every stop
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return source;
+
+  fseek(file, 0, SEEK_END);
+  source->size = ftell(file);
+  rewind(file);
+  source->data = malloc(source->size + 1);
+  source->size = fread(source->data, 1, source->size, file);
+  source->data[source->size] = '\0';
+  fclose(file);
+
+  size_t capacity = 64;
+  source->starts = malloc(capacity * sizeof(uint32_t));
+  source->starts[source->lines_count++] = 0;
+  for (size_t i = 0; i < source->size; i++) {
+    if (source->data[i] != '\n' || i + 1 == source->size)
+      continue;
+    if (source->lines_count == capacity) {
+      capacity *= 2;
+      source->starts = realloc(source->starts, capacity * sizeof(uint32_t));
+    }
+    source->starts[source->lines_count++] = i + 1;
+  }
+
+  return source;
+}
+
+// lines count from 1, the text isn't terminated
+const char *get_source_text(const char *file, uint32_t line, size_t *len) {
+  struct SourceFile *source = open_source(file);
+  if (!source->data || line == 0 || line > source->lines_count)
+    return NULL;
+
+  const char *start = source->data + source->starts[line - 1];
+  *len = strcspn(start, "\n");
+  return start;
+}
+
+void free_lines(void) {
+  for (size_t i = 0; i < dwarf.units_count; i++) {
+    for (size_t j = 0; j < dwarf.units[i].files_count; j++)
+      free(dwarf.units[i].files[j]);
+    free(dwarf.units[i].files);
+    free(dwarf.units[i].rows);
+  }
+  free(dwarf.units);
+  free(dwarf.ranges);
+
+  for (size_t i = 0; i < dwarf.sources_count; i++) {
+    free(dwarf.sources[i].path);
+    free(dwarf.sources[i].data);
+    free(dwarf.sources[i].starts);
+  }
+  free(dwarf.sources);
+
+  if (dwarf.elf)
+    munmap((void *)dwarf.elf, dwarf.elf_size);
+  memset(&dwarf, 0, sizeof(dwarf));
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct SourceLine {
+  const char *file;
+  uint32_t line;
+  // where the line's row starts, so address == pc means a line boundary
+  uint64_t address;
+  bool is_stmt;
+};
+
+bool find_line(int pid, uint64_t address, struct SourceLine *line);
+bool find_line_address(int pid, const char *file, uint32_t line,
+                       uint64_t *address);
+const char *get_source_text(const char *file, uint32_t line, size_t *len);
+void free_lines(void);
@@ -1,11 +1,30 @@
 #include "breakpoints.h"
+#include "cfg.h"
 #include "commands.h"
 #include "disassembler.h"
+#include "display.h"
 #include "eval.h"
+#include "events.h"
+#include "gdbserver.h"
+#include "heap.h"
+#include "jobs.h"
+#include "journal.h"
 #include "lexer.h"
+#include "lines.h"
+#include "maps.h"
+#include "memory.h"
 #include "parser.h"
+#include "render.h"
+#include "session.h"
+#include "signals.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "stepping.h"
 #include "ui.h"
+#include "xstate.h"
 #include <ctype.h>
+#include <getopt.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -14,6 +33,7 @@
 #include <sys/ioctl.h>
 #include <sys/personality.h>
 #include <sys/ptrace.h>
+#include <sys/signalfd.h>
 #include <sys/user.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -45,45 +65,56 @@ const struct {
     {"gs", REG_GS},
 };
 
-void draw_separator() {
-  printf("\033[34m");
-  for (size_t i = 0; i < w.ws_col; i++) {
-    printf("─");
+#define SEPARATOR "─"
+
+static void draw_rule(char *buffer, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    memcpy(buffer + i * strlen(SEPARATOR), SEPARATOR, strlen(SEPARATOR));
   }
-  printf("\033[0m\n");
+  buffer[count * strlen(SEPARATOR)] = '\0';
+}
+
+void draw_separator() {
+  char rule[w.ws_col * strlen(SEPARATOR) + 1];
+  draw_rule(rule, w.ws_col);
+  frame_printf(BLUE("%s") "\n", rule);
 }
 
 void draw_titled_separator(const char *title) {
   int len = strlen(title) + 4;
-  int side = (w.ws_col - len) / 2;
+  int side = len < w.ws_col ? (w.ws_col - len) / 2 : 0;
 
-  printf("\033[34m");
-  for (size_t i = 0; i < side; i++) {
-    printf("─");
-  }
-  printf("[ %s ]", title);
-  for (size_t i = 0; i < side; i++) {
-    printf("─");
-  }
-  printf("\033[0m\n");
+  char rule[side * strlen(SEPARATOR) + 1];
+  draw_rule(rule, side);
+  frame_printf(BLUE("%s[ %s ]%s") "\n", rule, title, rule);
 }
 
 void run_tracee(char *argv[]) {
   personality(ADDR_NO_RANDOMIZE);
-  ptrace(PTRACE_TRACEME, 0, 0, 0);
+  // the stop lets the tracer seize it before the exec. It stays in our
+  // process group so it can use the terminal, ^C reaches it as well
+  raise(SIGSTOP);
   execve(argv[0], argv, NULL);
 }
 
-struct CommandInstance read_command() {
+static bool read_command(FILE *input, struct CommandInstance *instance) {
   static char *prev_line = NULL;
   char *line = NULL;
 
   size_t len = 0;
 
-  len = getline(&line, &len, stdin);
+  ssize_t read = getline(&line, &len, input);
+  if (read == -1) {
+    free(line);
+    return false;
+  }
+
+  // scripts read like a session transcript
+  if (input != stdin)
+    fputs(line, stdout);
 
   bool is_empty = true;
-  for (size_t i = 0; i < len; i++) {
+  for (ssize_t i = 0; i < read; i++) {
     if (!isspace(line[i])) {
       is_empty = false;
       break;
@@ -94,100 +125,552 @@ struct CommandInstance read_command() {
     free(line);
     line = prev_line;
   } else {
+    line[strcspn(line, "\n")] = '\0';
     if (prev_line != NULL)
       free(prev_line);
     prev_line = line;
   }
 
-  return parse_cmd(line);
+  *instance = parse_cmd(line);
+  return true;
 }
 
-void run_tracer() {
+static void draw_view(struct user_regs_struct *prev_regs, bool has_prev_regs) {
   uint8_t instructions_buffer[DISASSEMBLY_LINES * MAX_INSTRUCTION_LENGTH];
 
-  int status;
+  enter_phase(PHASE_RENDER);
 
-  while (1) {
+  ioctl(0, TIOCGWINSZ, &w);
+  frame_begin(w.ws_row, w.ws_col);
 
-    waitpid(pid, &status, 0);
+  draw_titled_separator("REGISTERS");
 
-    if (WIFEXITED(status)) {
-      puts("exited.");
-      break;
-    }
+  for (size_t i = 0; i < REGISTERS_COUNT; i++) {
+    uint64_t value = *((uint64_t *)(&regs) + registers[i].reg);
+    bool changed = has_prev_regs &&
+                   value != *((uint64_t *)prev_regs + registers[i].reg);
 
-    ioctl(0, TIOCGWINSZ, &w);
+    if (changed)
+      frame_printf("   " BOLD("%s") "\t" RED("0x%lx") "\n", registers[i].name,
+                   value);
+    else
+      frame_printf("   " BOLD("%s") "\t0x%lx\n", registers[i].name, value);
+  }
 
-    draw_titled_separator("REGISTERS");
+  if (xregs_shown())
+    draw_xregs(pid);
 
-    ptrace(PTRACE_GETREGS, pid, 0, &regs);
+  draw_titled_separator("DISASSEMBLY");
 
-    for (size_t i = 0; i < REGISTERS_COUNT; i++) {
-      printf("   " BOLD("%s") "\t0x%lx\n", registers[i].name,
-             *((uint64_t *)(&regs) + registers[i].reg));
-    }
+  // the code as it runs, without heaptrack's int3s in it
+  memset(instructions_buffer, 0, sizeof(instructions_buffer));
+  read_memory(pid, regs.rip, instructions_buffer, sizeof(instructions_buffer));
+
+  disassemble(instructions_buffer, regs.rip);
+
+  draw_titled_separator("STACK");
+
+  for (int i = 0; i < STACK_LINES; i++) {
+    uint64_t value = PTRACE(PTRACE_PEEKDATA, pid, regs.rsp + i * 8, 0);
+    const struct Mapping *mapping = find_mapping(pid, value);
+    frame_printf("   " YELLOW("0x%llx") " —▸ %s0x%lx\033[0m", regs.rsp + i * 8,
+                 mapping_color(mapping), value);
+    if (mapping && mapping->path[0])
+      frame_printf(" (%s)", mapping->path);
+    frame_printf("\n");
+  }
+
+  if (has_displays()) {
+    draw_titled_separator("DISPLAY");
+    draw_displays(pid);
+  }
+
+  draw_separator();
+  frame_end();
+
+  enter_phase(PHASE_TRACER);
+}
+
+#define INTERRUPT_TIMEOUT_MS 1000
+// how long a ^C gets to stop the tracee by itself
+#define INTERRUPT_FALLBACK_MS 100
+#define RUNNING_PROMPT_MS 100
+
+// the tracee, the terminal and timers all come in through poll_events().
+// SIGCHLD and SIGINT stay blocked and are read from a signalfd instead
+static FILE *input;
+static int signal_fd;
+static sigset_t old_mask;
+// commands are read from the terminal even while the tracee runs
+static bool is_async;
+static bool is_running;
+static bool is_finished;
+static int status;
+static int result;
+
+static struct user_regs_struct prev_regs;
+static bool has_prev_regs;
+static size_t commands_count;
+
+static int interrupt_timer = -1;
+static int running_timer = -1;
+static bool is_interrupt_sent;
+// the tracee got a ^C typed at the prompt, it shows up once it runs again
+static bool has_stale_interrupt;
+
+static void stop_timer(int *timer) {
+  if (*timer == -1)
+    return;
+  cancel_timer(*timer);
+  *timer = -1;
+}
+
+static void prompt(void) {
+  // anything printed below the prompt scrolls the view out from under us
+  if (commands_count++ > 0)
+    frame_invalidate();
+
+  if (is_running)
+    printf(BOLD(RED("[running]> ")));
+  else
+    printf(BOLD(RED("[0x%llx]> ")), regs.rip);
+  fflush(stdout);
+}
+
+static void interrupt_tracee(void);
+
+static void on_interrupt_timeout(int fd, void *data) {
+  (void)fd;
+  (void)data;
+  interrupt_timer = -1;
+  if (!is_interrupt_sent) {
+    interrupt_tracee();
+    return;
+  }
+  puts("? Target hasn't stopped yet, it may be blocked in the kernel.");
+}
+
+static void interrupt_tracee(void) {
+  PTRACE(PTRACE_INTERRUPT, pid, 0, 0);
+  is_interrupt_sent = true;
+  if (interrupt_timer == -1)
+    interrupt_timer =
+        add_timer(INTERRUPT_TIMEOUT_MS, on_interrupt_timeout, NULL);
+}
+
+// the tracee got the same ^C and stops with its SIGINT, unless it blocks it
+// or the ^C didn't come from the terminal
+static void await_interrupt(void) {
+  if (interrupt_timer == -1)
+    interrupt_timer =
+        add_timer(INTERRUPT_FALLBACK_MS, on_interrupt_timeout, NULL);
+}
+
+// only once it's clear the tracee won't be right back
+static void on_running(int fd, void *data) {
+  (void)fd;
+  (void)data;
+  running_timer = -1;
+  prompt();
+}
+
+static void on_stop(void) {
+  is_running = false;
+
+  if (WIFEXITED(status)) {
+    stop_timer(&interrupt_timer);
+    stop_timer(&running_timer);
+    result = WEXITSTATUS(status);
+    printf("exited with status %d.\n", result);
+    is_finished = true;
+    return;
+  }
+
+  if (WIFSIGNALED(status)) {
+    stop_timer(&interrupt_timer);
+    stop_timer(&running_timer);
+    result = 128 + WTERMSIG(status);
+    printf("killed by %s.\n", strsignal(WTERMSIG(status)));
+    is_finished = true;
+    return;
+  }
+
+  int signal = WSTOPSIG(status);
+  enum StopCause cause = note_stop(status);
+
+  // signals are delivered before anything else runs, so a stale ^C is the
+  // first stop after the resume or never comes
+  bool is_stale =
+      cause == STOP_SIGNAL && signal == SIGINT && has_stale_interrupt;
+  has_stale_interrupt = false;
+  if (is_stale) {
+    PTRACE(get_last_resume(), pid, 0, 0);
+    is_running = true;
+    return;
+  }
+
+  // handed straight back, without so much as reading the registers
+  if (cause == STOP_SIGNAL && !should_stop(signal)) {
+    if (should_print(signal))
+      printf("%s %s.\n", should_pass(signal) ? "passed" : "discarded",
+             strsignal(signal));
+    PTRACE(get_last_resume(), pid, 0, should_pass(signal) ? signal : 0);
+    is_running = true;
+    return;
+  }
+
+  PTRACE(PTRACE_GETREGS, pid, 0, &regs);
+  invalidate_xstate();
+
+  if (cause == STOP_SYSCALL)
+    note_syscall(regs.orig_rax);
+  else if (cause == STOP_SIGNAL)
+    result = 128 + signal;
+
+  // nor do the allocator calls heaptrack records
+  if (continue_heap_tracking(pid, &regs, cause)) {
+    is_running = true;
+    return;
+  }
+
+  // the steps in between don't count as stops
+  if (continue_line_step(pid, &regs, cause) ||
+      continue_loop_exit(pid, &regs, cause)) {
+    is_running = true;
+    return;
+  }
+
+  stop_timer(&interrupt_timer);
+  stop_timer(&running_timer);
+  is_interrupt_sent = false;
+  note_signal(cause == STOP_SIGNAL ? signal : 0);
+
+  if (input != stdin) {
+    if (cause == STOP_SIGNAL || cause == STOP_GROUP)
+      printf("stopped at 0x%llx by %s.\n", regs.rip, strsignal(signal));
+    else if (cause == STOP_INTERRUPT)
+      printf("interrupted at 0x%llx.\n", regs.rip);
+    else if (cause == STOP_EXIT)
+      puts("about to exit.");
+  } else {
+    draw_view(&prev_regs, has_prev_regs);
+  }
+
+  prev_regs = regs;
+  has_prev_regs = true;
+  commands_count = 0;
+}
 
-    draw_titled_separator("DISASSEMBLY");
+static void on_signal(int fd, void *data) {
+  (void)data;
+  enter_phase(PHASE_TRACER);
 
-    for (size_t i = 0; i < DISASSEMBLY_LINES * MAX_INSTRUCTION_LENGTH; i += 8) {
-      uint64_t val = ptrace(PTRACE_PEEKDATA, pid, regs.rip + i, 0);
-      memcpy(instructions_buffer + i, &val, 8);
+  struct signalfd_siginfo info;
+  if (read(fd, &info, sizeof(info)) != sizeof(info))
+    return;
+
+  if (info.ssi_signo == SIGINT) {
+    if (is_running) {
+      await_interrupt();
+      return;
+    }
+    has_stale_interrupt = true;
+    if (is_async) {
+      // like a shell, drop the line
+      putchar('\n');
+      prompt();
     }
+    return;
+  }
+
+  if (!is_running || WAITPID(pid, &status, WNOHANG) != pid)
+    return;
 
-    disassemble(instructions_buffer, regs.rip);
+  on_stop();
+  if (is_async && !is_finished && !is_running)
+    prompt();
+}
+
+// a ^C typed at a blocking prompt isn't meant for the run that follows
+static void discard_interrupts(void) {
+  sigset_t int_mask;
+  sigemptyset(&int_mask);
+  sigaddset(&int_mask, SIGINT);
+  while (sigtimedwait(&int_mask, NULL, &(struct timespec){0}) == SIGINT)
+    has_stale_interrupt = true;
+}
 
-    draw_titled_separator("STACK");
+static void run_command(struct CommandInstance *instance) {
+  if (instance->cmd == NULL) {
+    puts("invalid command.");
+    return;
+  }
 
-    for (int i = 0; i < STACK_LINES; i++) {
-      uint64_t value = ptrace(PTRACE_PEEKDATA, pid, regs.rsp + i * 8, 0);
-      printf("   " YELLOW("0x%llx") " —▸ 0x%lx\n", regs.rsp + i * 8, value);
+  enum RunsWhen runs_when = instance->cmd->runs_when;
+  if (runs_when != WHEN_EITHER &&
+      is_running != (runs_when == WHEN_RUNNING)) {
+    puts(is_running ? "? Target is running, interrupt it first."
+                    : "? Target is not running.");
+    if (instance->arg)
+      free_node(instance->arg);
+    return;
+  }
+
+  int64_t value = 0;
+  if (instance->cmd->takes_arg) {
+    if (instance->arg == NULL) {
+      puts("missing argument.");
+      return;
     }
 
-    draw_separator();
+    bool is_valid = eval(instance->arg, &regs, &value);
+    free_node(instance->arg);
+    if (!is_valid)
+      return;
+  }
 
-    enum ExecState exec_state = PAUSE_EXEC;
+  switch (instance->cmd->handler(pid, value, instance->args)) {
+  case CONTINUE_EXEC:
+    is_running = true;
+    discard_interrupts();
+    if (is_async)
+      running_timer = add_timer(RUNNING_PROMPT_MS, on_running, NULL);
+    break;
+  case EXIT_EXEC:
+    is_finished = true;
+    break;
+  case INTERRUPT_EXEC:
+    interrupt_tracee();
+    break;
+  case PAUSE_EXEC:
+    break;
+  }
+}
 
-    while (exec_state == PAUSE_EXEC) {
-      printf(BOLD(RED("[0x%llx]> ")), regs.rip);
-      struct CommandInstance instance = read_command();
+static void on_input(int fd, void *data) {
+  (void)fd;
+  (void)data;
+  enter_phase(PHASE_TRACER);
 
-      if (instance.cmd == NULL) {
-        puts("invalid command.");
-        continue;
-      }
+  struct CommandInstance instance;
+  if (!read_command(input, &instance)) {
+    putchar('\n');
+    is_finished = true;
+    return;
+  }
 
-      int64_t value = 0;
-      if (instance.cmd->takes_arg) {
-        if (instance.arg == NULL) {
-          puts("missing argument.");
-          continue;
-        }
+  run_command(&instance);
+  if (!is_running && !is_finished)
+    prompt();
+}
 
-        value = eval(instance.arg, &regs);
-        if (instance.cmd->takes_arg)
-          free_node(instance.arg);
-      }
+// breakpoints and display expressions from the last interactive session of
+// this binary. Addresses carry over as they are, the tracee never gets
+// randomized
+static void restore_session(void) {
+  if (!load_session(pid))
+    return;
 
-      exec_state = instance.cmd->handler(pid, value);
+  size_t size;
+  const struct SavedBreakpoint *saved =
+      get_session_blob(BLOB_BREAKPOINTS, &size);
+  restore_breakpoints(pid, saved, size / sizeof(*saved));
+
+  const char *displays = get_session_blob(BLOB_DISPLAYS, &size);
+  restore_displays(displays, size);
+}
+
+static void store_session(void) {
+  struct SavedBreakpoint saved[MAX_BREAKPOINTS];
+  size_t count = save_breakpoints(saved);
+  set_session_blob(BLOB_BREAKPOINTS, saved, count * sizeof(*saved));
+
+  size_t size;
+  char *displays = save_displays(&size);
+  set_session_blob(BLOB_DISPLAYS, displays, size);
+  free(displays);
+
+  save_session();
+  free_session();
+}
+
+// seizes the stopped child and lets it run up to its exec. The gdbserver
+// starts its target the same way
+bool start_tracee(int tracee, int *stop_status) {
+  WAITPID(tracee, stop_status, WUNTRACED);
+  if (!WIFSTOPPED(*stop_status))
+    return false;
+
+  PTRACE(PTRACE_SEIZE, tracee, 0, TRACE_OPTIONS);
+  kill(tracee, SIGCONT);
+
+  while (WAITPID(tracee, stop_status, 0) == tracee &&
+         WIFSTOPPED(*stop_status)) {
+    if (*stop_status >> 16 == PTRACE_EVENT_EXEC)
+      return true;
+    // the SIGCONT, or the group stop it ends
+    PTRACE(PTRACE_CONT, tracee, 0, 0);
+  }
+  return true;
+}
+
+// returns the tracee's exit code, or 128 + the signal it was last stopped by
+int run_tracer(FILE *script) {
+  input = script ? script : stdin;
+  is_async = !script && isatty(STDIN_FILENO);
+
+  if (!start_tracee(pid, &status)) {
+    puts("? Target didn't start.");
+    return 1;
+  }
+
+  // scripts bring their own state
+  if (!script)
+    restore_session();
+
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGINT);
+  sigprocmask(SIG_BLOCK, &mask, &old_mask);
+  signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+  watch_fd(signal_fd, on_signal, NULL);
+
+  if (is_async)
+    is_async = watch_fd(STDIN_FILENO, on_input, NULL);
+
+  on_stop();
+  if (is_async && !is_finished)
+    prompt();
+
+  while (!is_finished) {
+    if (is_running || is_async) {
+      enter_phase(is_running ? PHASE_TRACEE : PHASE_PROMPT);
+      poll_events();
+      continue;
     }
 
-    if (exec_state == EXIT_EXEC) {
-      goto _cleanup;
+    prompt();
+
+    struct CommandInstance instance;
+    enter_phase(PHASE_PROMPT);
+    bool has_command = read_command(input, &instance);
+    enter_phase(PHASE_TRACER);
+
+    if (!has_command) {
+      putchar('\n');
+      break;
     }
+
+    run_command(&instance);
   }
-_cleanup:
+
+  enter_phase(PHASE_TRACER);
+  free_events();
+  close(signal_fd);
+  sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+  // their temporary breakpoints don't belong in the session
+  cancel_line_step(pid);
+  cancel_loop_exit(pid);
+  if (!script)
+    store_session();
+
   free_breakpoints(pid);
+  free_cfgs();
+  free_displays();
+  free_heap();
+  free_snapshot();
+  free_journal();
+  free_lines();
+  free_mappings();
+  free_frames();
+  dump_stats();
+  return result;
+}
+
+int debug(char *argv[], FILE *script) {
+  pid = fork();
+  if (pid == 0) {
+    run_tracee(argv);
+    perror(argv[0]);
+    exit(127);
+  }
+
+  return run_tracer(script);
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [-x script] [-j jobs] [-s stats.json] "
+         "[--gdbserver host:port|path] [--] exec-file [args...]\n",
+         name);
+  puts("  -x script  run debugger commands from script instead of the terminal");
+  puts("  -s file    write debugger performance counters to file on exit");
+  puts("  --gdbserver address");
+  puts("             serve the target over the GDB remote protocol on a TCP");
+  puts("             [host]:port or a unix socket path");
+  puts("  -j jobs    with a {} argument, debug one target per line of stdin,");
+  puts("             running up to jobs of them in parallel (requires -x)");
+  exit(1);
 }
 
 int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    printf("Usage: %s exec-file\n", argv[0]);
+  const char *script_path = NULL;
+  const char *gdbserver_address = NULL;
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  static const struct option long_options[] = {
+      {"gdbserver", required_argument, NULL, 'G'},
+      {NULL, 0, NULL, 0},
+  };
+
+  while ((opt = getopt_long(argc, argv, "+x:j:s:", long_options, NULL)) !=
+         -1) {
+    switch (opt) {
+    case 'G':
+      gdbserver_address = optarg;
+      break;
+    case 'x':
+      script_path = optarg;
+      break;
+    case 's':
+      set_stats_path(optarg);
+      break;
+    case 'j':
+      jobs = strtol(optarg, NULL, 10);
+      if (jobs < 1)
+        usage(argv[0]);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (optind >= argc)
+    usage(argv[0]);
+
+  char **target_argv = &argv[optind];
+
+  if (gdbserver_address)
+    return run_gdbserver(gdbserver_address, target_argv);
+
+  if (has_placeholder(target_argv)) {
+    if (!script_path)
+      usage(argv[0]);
+    return run_jobs(jobs, script_path, target_argv);
+  }
+
+  FILE *script = NULL;
+  if (script_path && !(script = fopen(script_path, "r"))) {
+    perror(script_path);
     exit(1);
   }
 
-  pid = fork();
-  if (pid == 0)
-    run_tracee(&argv[1]);
-  else
-    run_tracer();
+  int result = debug(target_argv, script);
+
+  if (script)
+    fclose(script);
+
+  return result;
 }
@@ -0,0 +1,132 @@
+#include "maps.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+
+// mappings never overlap, so a sorted array is all the interval index we need
+static struct Mapping *mappings = NULL;
+static size_t mappings_count = 0;
+static size_t mappings_capacity = 0;
+static bool is_stale = true;
+
+void free_mappings(void) {
+  for (size_t i = 0; i < mappings_count; i++) {
+    free(mappings[i].path);
+  }
+  free(mappings);
+  mappings = NULL;
+  mappings_count = 0;
+  mappings_capacity = 0;
+  is_stale = true;
+}
+
+static void push_mapping(struct Mapping *mapping) {
+  if (mappings_count == mappings_capacity) {
+    mappings_capacity = mappings_capacity ? mappings_capacity * 2 : 32;
+    mappings = realloc(mappings, mappings_capacity * sizeof(struct Mapping));
+    assert(mappings);
+  }
+  mappings[mappings_count++] = *mapping;
+}
+
+static void load_mappings(int pid) {
+  for (size_t i = 0; i < mappings_count; i++) {
+    free(mappings[i].path);
+  }
+  mappings_count = 0;
+
+  char maps_path[32];
+  snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", pid);
+
+  FILE *file = fopen(maps_path, "r");
+  if (!file)
+    return;
+
+  char *line = NULL;
+  size_t len = 0;
+
+  while (getline(&line, &len, file) != -1) {
+    struct Mapping mapping = {0};
+    int path_start = 0;
+
+    // the kernel already hands these out sorted by address
+    if (sscanf(line, "%lx-%lx %4s %lx %*s %*u %n", &mapping.start, &mapping.end,
+               mapping.perms, &mapping.offset, &path_start) < 4)
+      continue;
+
+    line[strcspn(line, "\n")] = '\0';
+    mapping.path = strdup(line + path_start);
+    push_mapping(&mapping);
+  }
+
+  free(line);
+  fclose(file);
+  is_stale = false;
+}
+
+const struct Mapping *find_mapping(int pid, uint64_t address) {
+  if (is_stale)
+    load_mappings(pid);
+
+  size_t lo = 0, hi = mappings_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (address < mappings[mid].start)
+      hi = mid;
+    else if (address >= mappings[mid].end)
+      lo = mid + 1;
+    else
+      return &mappings[mid];
+  }
+
+  return NULL;
+}
+
+const struct Mapping *get_mappings(int pid, size_t *count) {
+  if (is_stale)
+    load_mappings(pid);
+
+  *count = mappings_count;
+  return mappings;
+}
+
+void invalidate_mappings(void) { is_stale = true; }
+
+void note_syscall(uint64_t syscall_nr) {
+  switch (syscall_nr) {
+  case SYS_mmap:
+  case SYS_munmap:
+  case SYS_mprotect:
+  case SYS_mremap:
+  case SYS_brk:
+    is_stale = true;
+    break;
+  }
+}
+
+const char *mapping_color(const struct Mapping *mapping) {
+  if (!mapping)
+    return "";
+  if (strcmp(mapping->path, "[stack]") == 0)
+    return "\033[33m";
+  if (strcmp(mapping->path, "[heap]") == 0)
+    return "\033[34m";
+  if (mapping->perms[2] == 'x')
+    return "\033[31m";
+  return "\033[35m";
+}
+
+void list_mappings(int pid) {
+  if (is_stale)
+    load_mappings(pid);
+
+  for (size_t i = 0; i < mappings_count; i++) {
+    struct Mapping *mapping = &mappings[i];
+    printf("%s0x%012lx 0x%012lx\033[0m %s %8lx %s\n", mapping_color(mapping),
+           mapping->start, mapping->end, mapping->perms, mapping->offset,
+           mapping->path);
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct Mapping {
+  uint64_t start;
+  uint64_t end;
+  uint64_t offset;
+  char perms[5];
+  char *path;
+};
+
+const struct Mapping *find_mapping(int pid, uint64_t address);
+const struct Mapping *get_mappings(int pid, size_t *count);
+void list_mappings(int pid);
+void invalidate_mappings(void);
+void note_syscall(uint64_t syscall_nr);
+const char *mapping_color(const struct Mapping *mapping);
+void free_mappings(void);
@@ -0,0 +1,56 @@
+#define _GNU_SOURCE
+#include "memory.h"
+#include "heap.h"
+#include "journal.h"
+#include "stats.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static int open_mem(int pid, int flags) {
+  char mem_path[32];
+  snprintf(mem_path, sizeof(mem_path), "/proc/%d/mem", pid);
+  return open(mem_path, flags);
+}
+
+// one syscall for the whole range instead of a PEEKDATA per word
+ssize_t read_memory(int pid, uint64_t address, void *buffer, size_t length) {
+  struct iovec local = {buffer, length};
+  struct iovec remote = {(void *)address, length};
+
+  ssize_t res = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+
+  // process_vm_readv honours page protections, /proc/pid/mem doesn't
+  if (res < (ssize_t)length) {
+    int fd = open_mem(pid, O_RDONLY);
+    if (fd != -1) {
+      ssize_t mem_res = pread(fd, buffer, length, address);
+      if (mem_res > res)
+        res = mem_res;
+      close(fd);
+    }
+  }
+
+  if (res > 0) {
+    note_memory_read(res);
+    overlay_traps(address, buffer, res);
+    overlay_staged(address, buffer, res);
+  }
+
+  return res;
+}
+
+ssize_t write_memory(int pid, uint64_t address, const void *buffer,
+                     size_t length) {
+  // unlike process_vm_writev this also gets through to read-only text
+  int fd = open_mem(pid, O_WRONLY);
+  if (fd == -1)
+    return -1;
+
+  ssize_t res = pwrite(fd, buffer, length, address);
+  close(fd);
+  if (res > 0)
+    rearm_traps(pid, address, res);
+  return res;
+}
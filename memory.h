@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+ssize_t read_memory(int pid, uint64_t address, void *buffer, size_t length);
+ssize_t write_memory(int pid, uint64_t address, const void *buffer,
+                     size_t length);
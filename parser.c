@@ -2,6 +2,7 @@
 #include "commands.h"
 #include "lexer.h"
 #include <assert.h>
+#include <ctype.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,6 +17,8 @@ enum OperatorType : uint8_t {
   OP_DIV = TOK_DIV,
   OP_LPAREN = TOK_LPAREN,
   OP_RPAREN = TOK_RPAREN,
+  OP_LBRACKET = TOK_LBRACKET,
+  OP_RBRACKET = TOK_RBRACKET,
 };
 
 struct Operator {
@@ -24,8 +27,9 @@ struct Operator {
 };
 
 static struct Operator operators[] = {
-    {OP_ADD, 1}, {OP_SUB, 1},    {OP_MUL, 2},
-    {OP_DIV, 2}, {OP_LPAREN, 0}, {OP_RPAREN, 0},
+    {OP_ADD, 1},      {OP_SUB, 1},      {OP_MUL, 2},
+    {OP_DIV, 2},      {OP_LPAREN, 0},   {OP_RPAREN, 0},
+    {OP_LBRACKET, 0}, {OP_RBRACKET, 0},
 };
 
 static inline struct Operator *is_operator(struct Token *token) {
@@ -80,6 +84,9 @@ static inline struct Operator *pop_operator() {
 }
 
 static struct Node *parse_expr(struct Lexer *lexer) {
+  // whatever an earlier failed parse left behind
+  value_stack_cur = 0;
+  operator_stack_cur = 0;
 
   while (1) {
     struct Token token = next_token(lexer);
@@ -109,17 +116,42 @@ static struct Node *parse_expr(struct Lexer *lexer) {
     struct Operator *op;
 
     if ((op = is_operator(&token))) {
-      if (op->op == OP_LPAREN) {
+      if (op->op == OP_LPAREN || op->op == OP_LBRACKET) {
         push_operator(op);
         continue;
       }
 
-      if (op->op == OP_RPAREN) {
-        while (operator_stack_cur > 0) {
+      // like a closing parenthesis, then the value inside gets dereferenced
+      if (op->op == OP_RBRACKET) {
+        while (true) {
+          struct Operator *top_op = TRY(pop_operator());
+          if (top_op->op == OP_LBRACKET)
+            break;
+          // a parenthesis opened inside the brackets is still open
+          TRY(top_op->op != OP_LPAREN);
+
+          struct Node *node = malloc(sizeof(struct Node));
+          node->type = (enum NodeType)top_op->op;
+
+          node->value.as_bi_op.rhs = TRY(pop_value());
+          node->value.as_bi_op.lhs = TRY(pop_value());
 
+          push_value(node);
+        }
+
+        struct Node *node = malloc(sizeof(struct Node));
+        node->type = NODE_DEREF;
+        node->value.as_operand = TRY(pop_value());
+        push_value(node);
+        continue;
+      }
+
+      if (op->op == OP_RPAREN) {
+        while (true) {
           struct Operator *top_op = TRY(pop_operator());
           if (top_op->op == OP_LPAREN)
             break;
+          TRY(top_op->op != OP_LBRACKET);
 
           struct Node *node = malloc(sizeof(struct Node));
           node->type = (enum NodeType)top_op->op;
@@ -135,8 +167,10 @@ static struct Node *parse_expr(struct Lexer *lexer) {
       while (operator_stack_cur > 0) {
 
         struct Operator *top_op = TRY(pop_operator());
-        if (top_op->precedence < op->precedence)
+        if (top_op->precedence < op->precedence) {
+          push_operator(top_op);
           break;
+        }
 
         struct Node *node = malloc(sizeof(struct Node));
         node->type = (enum NodeType)top_op->op;
@@ -153,8 +187,12 @@ static struct Node *parse_expr(struct Lexer *lexer) {
   }
 
   while (operator_stack_cur > 0) {
+    struct Operator *top_op = TRY(pop_operator());
+    // an opener that never got closed
+    TRY(top_op->op != OP_LPAREN && top_op->op != OP_LBRACKET);
+
     struct Node *node = malloc(sizeof(struct Node));
-    node->type = (enum NodeType)TRY(pop_operator())->op;
+    node->type = (enum NodeType)top_op->op;
 
     node->value.as_bi_op.rhs = TRY(pop_value());
     node->value.as_bi_op.lhs = TRY(pop_value());
@@ -165,11 +203,22 @@ static struct Node *parse_expr(struct Lexer *lexer) {
   return pop_value();
 }
 
+struct Node *parse_expression(char *source) {
+  struct Lexer lexer;
+  lexer_init(&lexer, source);
+  return parse_expr(&lexer);
+}
+
 void free_node(struct Node *node) {
   if (node->type == NODE_NUMBER || node->type == NODE_REGISTER) {
     free(node);
     return;
   }
+  if (node->type == NODE_DEREF) {
+    free_node(node->value.as_operand);
+    free(node);
+    return;
+  }
   free_node(node->value.as_bi_op.lhs);
   free_node(node->value.as_bi_op.rhs);
   free(node);
@@ -192,6 +241,10 @@ struct CommandInstance parse_cmd(char *const line) {
     return instance;
   }
 
+  instance.args = lexer.current;
+  while (isspace(*instance.args))
+    instance.args++;
+
   for (size_t i = 0; commands[i].handler; i++) {
     if (strncmp(token.value.as_literal.start, commands[i].alias,
                 token.value.as_literal.length) == 0) {
@@ -11,6 +11,8 @@ enum NodeType {
   NODE_MUL = TOK_MUL,
   NODE_SUB = TOK_SUB,
   NODE_DIV = TOK_DIV,
+  // [address], the quadword there
+  NODE_DEREF = TOK_LBRACKET,
 };
 
 struct Node {
@@ -22,8 +24,10 @@ struct Node {
       struct Node *lhs;
       struct Node *rhs;
     } as_bi_op;
+    struct Node *as_operand;
   } value;
 };
 
 struct CommandInstance parse_cmd(char *line);
+struct Node *parse_expression(char *source);
 void free_node(struct Node *node);
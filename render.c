@@ -0,0 +1,195 @@
+#include "render.h"
+#include <assert.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct Frame {
+  char *data;
+  size_t length;
+  size_t capacity;
+  // offsets of the first character of every line in data
+  size_t *lines;
+  size_t lines_count;
+  size_t lines_capacity;
+  // a line wrapped, so lines and screen rows no longer line up
+  bool is_wrapped;
+};
+
+static struct Frame frames[2];
+static struct Frame *current = &frames[0];
+static struct Frame *previous = &frames[1];
+
+// escape sequences sent to the terminal, built up before the single write
+static struct Frame output;
+
+static uint16_t screen_rows, screen_cols;
+static bool is_valid = false;
+
+static void reserve(struct Frame *frame, size_t extra) {
+  if (frame->length + extra <= frame->capacity)
+    return;
+
+  while (frame->length + extra > frame->capacity)
+    frame->capacity = frame->capacity ? frame->capacity * 2 : 4096;
+
+  frame->data = realloc(frame->data, frame->capacity);
+  assert(frame->data);
+}
+
+static void vappend(struct Frame *frame, const char *fmt, va_list args) {
+  va_list copy;
+  va_copy(copy, args);
+  int len = vsnprintf(NULL, 0, fmt, copy);
+  va_end(copy);
+
+  reserve(frame, len + 1);
+  vsnprintf(frame->data + frame->length, len + 1, fmt, args);
+  frame->length += len;
+}
+
+static void append(struct Frame *frame, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vappend(frame, fmt, args);
+  va_end(args);
+}
+
+static void append_bytes(struct Frame *frame, const char *bytes, size_t len) {
+  reserve(frame, len);
+  memcpy(frame->data + frame->length, bytes, len);
+  frame->length += len;
+}
+
+static void push_line(struct Frame *frame, size_t offset) {
+  if (frame->lines_count == frame->lines_capacity) {
+    frame->lines_capacity = frame->lines_capacity ? frame->lines_capacity * 2 : 64;
+    frame->lines = realloc(frame->lines, frame->lines_capacity * sizeof(size_t));
+    assert(frame->lines);
+  }
+  frame->lines[frame->lines_count++] = offset;
+}
+
+static size_t line_length(struct Frame *frame, size_t i) {
+  size_t end = i + 1 < frame->lines_count ? frame->lines[i + 1] : frame->length;
+  return end - frame->lines[i];
+}
+
+// escape sequences take no columns, a UTF-8 sequence takes one and a tab
+// runs to the next stop
+static size_t line_width(const char *line, size_t len) {
+  size_t width = 0;
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = line[i];
+    if (c == '\033' && i + 1 < len && line[i + 1] == '[') {
+      // up to the final byte of the CSI sequence
+      for (i += 2; i < len && (line[i] < 0x40 || line[i] > 0x7e); i++)
+        ;
+    } else if (c == '\t') {
+      width = (width / 8 + 1) * 8;
+    } else if (c != '\n' && (c & 0xc0) != 0x80) {
+      width++;
+    }
+  }
+  return width;
+}
+
+static bool is_wrapped(struct Frame *frame) {
+  for (size_t i = 0; i < frame->lines_count; i++) {
+    if (line_width(frame->data + frame->lines[i], line_length(frame, i)) >
+        screen_cols)
+      return true;
+  }
+  return false;
+}
+
+void frame_invalidate(void) { is_valid = false; }
+
+void frame_begin(uint16_t rows, uint16_t cols) {
+  if (rows != screen_rows || cols != screen_cols)
+    is_valid = false;
+
+  screen_rows = rows;
+  screen_cols = cols;
+
+  current->length = 0;
+  current->lines_count = 0;
+}
+
+void frame_printf(const char *fmt, ...) {
+  size_t start = current->length;
+
+  va_list args;
+  va_start(args, fmt);
+  vappend(current, fmt, args);
+  va_end(args);
+
+  // split on newlines so every line can be compared against the last frame
+  for (size_t i = start; i < current->length; i++) {
+    if (i == 0 || current->data[i - 1] == '\n')
+      push_line(current, i);
+  }
+}
+
+void frame_end(void) {
+  output.length = 0;
+
+  // the prompt and the echoed command take two more rows, anything taller
+  // than the screen has scrolled, or is about to, and can't be patched in
+  // place. Neither can anything where a line took more than one row
+  current->is_wrapped = is_wrapped(current);
+  if (previous->lines_count + 2 > screen_rows ||
+      current->lines_count + 2 > screen_rows || previous->is_wrapped ||
+      current->is_wrapped)
+    is_valid = false;
+
+  if (!is_valid)
+    append(&output, "\033[H\033[2J");
+
+  for (size_t i = 0; i < current->lines_count; i++) {
+    size_t len = line_length(current, i);
+    const char *line = current->data + current->lines[i];
+
+    if (is_valid && i < previous->lines_count &&
+        len == line_length(previous, i) &&
+        memcmp(line, previous->data + previous->lines[i], len) == 0)
+      continue;
+
+    if (is_valid)
+      append(&output, "\033[%zu;1H\033[2K", i + 1);
+    append_bytes(&output, line, len);
+  }
+
+  if (is_valid)
+    append(&output, "\033[%zu;1H\033[J", current->lines_count + 1);
+
+  fflush(stdout);
+  for (size_t written = 0; written < output.length;) {
+    ssize_t res = write(STDOUT_FILENO, output.data + written,
+                        output.length - written);
+    if (res <= 0)
+      break;
+    written += res;
+  }
+
+  struct Frame *tmp = previous;
+  previous = current;
+  current = tmp;
+  is_valid = true;
+}
+
+void free_frames(void) {
+  for (size_t i = 0; i < 2; i++) {
+    free(frames[i].data);
+    free(frames[i].lines);
+  }
+  free(output.data);
+  free(output.lines);
+  memset(frames, 0, sizeof(frames));
+  memset(&output, 0, sizeof(output));
+  is_valid = false;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+void frame_begin(uint16_t rows, uint16_t cols);
+void frame_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void frame_end(void);
+void frame_invalidate(void);
+void free_frames(void);
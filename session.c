@@ -0,0 +1,270 @@
+#include "session.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SESSION_MAGIC "dbgsess"
+#define SESSION_VERSION 2
+#define MAX_BUILD_ID 32
+
+// blobs are used straight from the mapping, so everything sits at fixed,
+// 8 byte aligned offsets
+struct SessionHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t build_id_length;
+  uint8_t build_id[MAX_BUILD_ID];
+  int64_t mtime_ns;
+  uint64_t size;
+  struct {
+    uint64_t offset;
+    uint64_t size;
+  } blobs[BLOBS_COUNT];
+};
+
+static struct {
+  bool has_key;
+  char path[PATH_MAX];
+  // the binary the session belongs to
+  struct SessionHeader key;
+  const uint8_t *map;
+  size_t map_size;
+  // blobs set this time around, the others are written back as loaded
+  void *blobs[BLOBS_COUNT];
+  size_t blob_sizes[BLOBS_COUNT];
+  bool is_set[BLOBS_COUNT];
+} session;
+
+static uint32_t read_build_id(const uint8_t *elf, size_t size, uint8_t *id) {
+  if (size < sizeof(Elf64_Ehdr) || memcmp(elf, ELFMAG, SELFMAG) != 0 ||
+      elf[EI_CLASS] != ELFCLASS64)
+    return 0;
+
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)elf;
+  if (ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) > size)
+    return 0;
+
+  const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(elf + ehdr->e_phoff);
+  for (size_t i = 0; i < ehdr->e_phnum; i++) {
+    if (phdrs[i].p_type != PT_NOTE ||
+        phdrs[i].p_offset + phdrs[i].p_filesz > size)
+      continue;
+
+    const uint8_t *note = elf + phdrs[i].p_offset;
+    const uint8_t *end = note + phdrs[i].p_filesz;
+    while (note + sizeof(Elf64_Nhdr) <= end) {
+      const Elf64_Nhdr *nhdr = (const Elf64_Nhdr *)note;
+      const uint8_t *name = note + sizeof(Elf64_Nhdr);
+      const uint8_t *desc = name + ((nhdr->n_namesz + 3) & ~3);
+      note = desc + ((nhdr->n_descsz + 3) & ~3);
+      if (note > end)
+        break;
+
+      if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+          memcmp(name, "GNU", 4) == 0 && nhdr->n_descsz <= MAX_BUILD_ID) {
+        memcpy(id, desc, nhdr->n_descsz);
+        return nhdr->n_descsz;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static bool make_cache_dir(char *dir, size_t size) {
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+
+  if (xdg && xdg[0]) {
+    snprintf(dir, size, "%s", xdg);
+  } else if (home) {
+    snprintf(dir, size, "%s/.cache", home);
+    mkdir(dir, 0755);
+  } else {
+    return false;
+  }
+
+  strncat(dir, "/debooger", size - strlen(dir) - 1);
+  mkdir(dir, 0755);
+  return access(dir, W_OK) == 0;
+}
+
+// build-id when there is one, a hash of the path otherwise
+static void make_cache_name(char *name, size_t size, const char *exe) {
+  if (session.key.build_id_length) {
+    for (size_t i = 0; i < session.key.build_id_length && 2 * i + 2 < size;
+         i++)
+      sprintf(name + 2 * i, "%02x", session.key.build_id[i]);
+    return;
+  }
+
+  char path[PATH_MAX] = {0};
+  readlink(exe, path, sizeof(path) - 1);
+
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const char *c = path; *c; c++)
+    hash = (hash ^ (uint8_t)*c) * 0x100000001b3;
+  snprintf(name, size, "path-%016lx", hash);
+}
+
+static bool is_valid(const uint8_t *map, size_t size) {
+  if (size < sizeof(struct SessionHeader))
+    return false;
+
+  const struct SessionHeader *header = (const struct SessionHeader *)map;
+  if (memcmp(header->magic, SESSION_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != SESSION_VERSION ||
+      header->build_id_length != session.key.build_id_length ||
+      memcmp(header->build_id, session.key.build_id,
+             header->build_id_length) != 0 ||
+      header->mtime_ns != session.key.mtime_ns ||
+      header->size != session.key.size)
+    return false;
+
+  for (size_t i = 0; i < BLOBS_COUNT; i++) {
+    if (header->blobs[i].offset > size ||
+        header->blobs[i].size > size - header->blobs[i].offset)
+      return false;
+  }
+  return true;
+}
+
+// true when there was a session for the tracee's binary to map in
+bool load_session(int pid) {
+  char exe[64];
+  snprintf(exe, sizeof(exe), "/proc/%d/exe", pid);
+
+  int fd = open(exe, O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+  fstat(fd, &st);
+  session.key.mtime_ns = st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+  session.key.size = st.st_size;
+
+  void *elf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (elf != MAP_FAILED) {
+    session.key.build_id_length =
+        read_build_id(elf, st.st_size, session.key.build_id);
+    munmap(elf, st.st_size);
+  }
+
+  char dir[PATH_MAX - 128];
+  if (!make_cache_dir(dir, sizeof(dir)))
+    return false;
+
+  char name[2 * MAX_BUILD_ID + 1];
+  make_cache_name(name, sizeof(name), exe);
+  snprintf(session.path, sizeof(session.path), "%s/%s.session", dir, name);
+  session.has_key = true;
+
+  fd = open(session.path, O_RDONLY);
+  if (fd == -1)
+    return false;
+
+  fstat(fd, &st);
+  const uint8_t *map =
+      st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                 : MAP_FAILED;
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  // a rebuilt binary, or a file from another version of us
+  if (!is_valid(map, st.st_size)) {
+    munmap((void *)map, st.st_size);
+    return false;
+  }
+
+  session.map = map;
+  session.map_size = st.st_size;
+  return true;
+}
+
+const void *get_session_blob(enum SessionBlob blob, size_t *size) {
+  if (session.is_set[blob]) {
+    *size = session.blob_sizes[blob];
+    return session.blobs[blob];
+  }
+
+  if (!session.map) {
+    *size = 0;
+    return NULL;
+  }
+
+  const struct SessionHeader *header =
+      (const struct SessionHeader *)session.map;
+  *size = header->blobs[blob].size;
+  return session.map + header->blobs[blob].offset;
+}
+
+void set_session_blob(enum SessionBlob blob, const void *data, size_t size) {
+  free(session.blobs[blob]);
+  session.blobs[blob] = size ? malloc(size) : NULL;
+  if (size)
+    memcpy(session.blobs[blob], data, size);
+  session.blob_sizes[blob] = size;
+  session.is_set[blob] = true;
+}
+
+void save_session(void) {
+  if (!session.has_key)
+    return;
+
+  const void *blobs[BLOBS_COUNT];
+  struct SessionHeader header = session.key;
+  memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+  header.version = SESSION_VERSION;
+
+  bool is_empty = true;
+  uint64_t offset = sizeof(header);
+  for (size_t i = 0; i < BLOBS_COUNT; i++) {
+    blobs[i] = get_session_blob(i, &header.blobs[i].size);
+    header.blobs[i].offset = offset;
+    offset = (offset + header.blobs[i].size + 7) & ~7ull;
+    is_empty &= header.blobs[i].size == 0;
+  }
+
+  // don't litter the cache with nothing, unless it's replacing something
+  if (is_empty && !session.map)
+    return;
+
+  // parallel sessions of one binary each write their own file, the last
+  // rename wins
+  char tmp_path[PATH_MAX + 16];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%d", session.path, getpid());
+
+  FILE *file = fopen(tmp_path, "w");
+  if (!file) {
+    perror(tmp_path);
+    return;
+  }
+
+  fwrite(&header, sizeof(header), 1, file);
+  for (size_t i = 0; i < BLOBS_COUNT; i++) {
+    fseek(file, header.blobs[i].offset, SEEK_SET);
+    fwrite(blobs[i], 1, header.blobs[i].size, file);
+  }
+
+  if (fclose(file) == 0)
+    rename(tmp_path, session.path);
+  else
+    unlink(tmp_path);
+}
+
+void free_session(void) {
+  if (session.map)
+    munmap((void *)session.map, session.map_size);
+  for (size_t i = 0; i < BLOBS_COUNT; i++)
+    free(session.blobs[i]);
+  memset(&session, 0, sizeof(session));
+}
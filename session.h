@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// what a session file holds besides its header, one blob each
+enum SessionBlob : uint32_t {
+  BLOB_BREAKPOINTS,
+  BLOB_DISPLAYS,
+  BLOBS_COUNT,
+};
+
+bool load_session(int pid);
+const void *get_session_blob(enum SessionBlob blob, size_t *size);
+void set_session_blob(enum SessionBlob blob, const void *data, size_t size);
+void save_session(void);
+void free_session(void);
@@ -0,0 +1,154 @@
+#define _GNU_SOURCE
+#include "signals.h"
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// zeroed means stop, print and pass it on to the tracee. The timer and
+// notification signals busy programs live on don't stop by default, ^C and
+// SIGTRAP are the debugger's own
+static struct {
+  bool is_nostop;
+  bool is_noprint;
+  bool is_nopass;
+} dispositions[NSIG] = {
+    [SIGINT] = {.is_nopass = true},   [SIGTRAP] = {.is_nopass = true},
+    [SIGALRM] = {true, true, false},  [SIGURG] = {true, true, false},
+    [SIGCHLD] = {true, true, false},  [SIGWINCH] = {true, true, false},
+    [SIGVTALRM] = {true, true, false}, [SIGPROF] = {true, true, false},
+    [SIGIO] = {true, true, false},
+};
+
+// what the last stop was by, for the next resume to deliver. One the user
+// asked for with the signal command goes out whatever handle says
+static int pending_signal;
+static bool is_requested;
+
+bool should_stop(int signal) { return !dispositions[signal].is_nostop; }
+
+bool should_print(int signal) { return !dispositions[signal].is_noprint; }
+
+bool should_pass(int signal) { return !dispositions[signal].is_nopass; }
+
+// 0 for a stop that wasn't a signal
+void note_signal(int signal) {
+  pending_signal = signal;
+  is_requested = false;
+}
+
+// pass or nopass as of the resume, handle may have changed since the stop
+int take_signal(void) {
+  int signal = pending_signal;
+  bool is_passed = is_requested || should_pass(signal);
+  pending_signal = 0;
+  is_requested = false;
+  return is_passed ? signal : 0;
+}
+
+static void signal_name(int signal, char *name, size_t size) {
+  const char *abbrev = sigabbrev_np(signal);
+  if (abbrev)
+    snprintf(name, size, "SIG%s", abbrev);
+  else
+    snprintf(name, size, "SIG%d", signal);
+}
+
+// SIGALRM, ALRM or 14
+static int parse_signal(const char *text) {
+  if (isdigit(*text)) {
+    long signal = strtol(text, NULL, 10);
+    return signal > 0 && signal < NSIG ? signal : 0;
+  }
+
+  if (strncasecmp(text, "SIG", 3) == 0)
+    text += 3;
+  for (int i = 1; i < NSIG; i++) {
+    const char *abbrev = sigabbrev_np(i);
+    if (abbrev && strcasecmp(text, abbrev) == 0)
+      return i;
+  }
+  return 0;
+}
+
+// signal [0|SIG], what the next resume delivers. 0 drops the signal the
+// target stopped with, without arguments it's shown
+void replace_signal(char *args) {
+  char name[16];
+  char *word = strtok(args, " \t");
+  if (word && strcmp(word, "0") == 0) {
+    pending_signal = 0;
+    return;
+  }
+
+  if (word) {
+    int signal = parse_signal(word);
+    if (!signal) {
+      printf("? No signal %s.\n", word);
+      return;
+    }
+    pending_signal = signal;
+    is_requested = true;
+    return;
+  }
+
+  if (!pending_signal || !(is_requested || should_pass(pending_signal))) {
+    puts("no signal to deliver.");
+    return;
+  }
+  signal_name(pending_signal, name, sizeof(name));
+  printf("%s on resume.\n", name);
+}
+
+static void print_disposition(int signal) {
+  char name[16];
+  signal_name(signal, name, sizeof(name));
+  printf("   %-12s %-6s %-6s %s\n", name, should_stop(signal) ? "stop" : "",
+         should_print(signal) ? "print" : "",
+         should_pass(signal) ? "pass" : "");
+}
+
+// handle [SIG [stop|nostop|print|noprint|pass|nopass]...]. Like gdb, stopping
+// means printing and not printing means not stopping
+void handle_signal(char *args) {
+  char *word = strtok(args, " \t");
+  if (!word) {
+    for (int i = 1; i < SIGRTMIN; i++)
+      print_disposition(i);
+    return;
+  }
+
+  int signal = parse_signal(word);
+  if (!signal) {
+    printf("? No signal %s.\n", word);
+    return;
+  }
+
+  // all or nothing
+  typeof(dispositions[0]) disposition = dispositions[signal];
+  while ((word = strtok(NULL, " \t"))) {
+    if (strcmp(word, "stop") == 0) {
+      disposition.is_nostop = false;
+      disposition.is_noprint = false;
+    } else if (strcmp(word, "nostop") == 0) {
+      disposition.is_nostop = true;
+    } else if (strcmp(word, "print") == 0) {
+      disposition.is_noprint = false;
+    } else if (strcmp(word, "noprint") == 0) {
+      disposition.is_noprint = true;
+      disposition.is_nostop = true;
+    } else if (strcmp(word, "pass") == 0) {
+      disposition.is_nopass = false;
+    } else if (strcmp(word, "nopass") == 0) {
+      disposition.is_nopass = true;
+    } else {
+      printf("? %s isn't stop, nostop, print, noprint, pass or nopass.\n",
+             word);
+      return;
+    }
+  }
+  dispositions[signal] = disposition;
+  print_disposition(signal);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+
+bool should_stop(int signal);
+bool should_print(int signal);
+bool should_pass(int signal);
+void note_signal(int signal);
+int take_signal(void);
+void handle_signal(char *args);
+void replace_signal(char *args);
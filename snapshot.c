@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include "snapshot.h"
+#include "maps.h"
+#include "memory.h"
+#include "stats.h"
+#include "ui.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define PAGE_BYTES 4096
+// pagemap entry bits, see Documentation/admin-guide/mm/pagemap.rst
+#define PM_SOFT_DIRTY (1ull << 55)
+// dirty pages read per process_vm_readv
+#define DIFF_BATCH_PAGES 256
+#define DIFF_SHOWN 32
+// past this a mapping is address space set aside rather than used, like a
+// sanitizer's shadow memory, and it doesn't get copied
+#define MAX_REGION_BYTES (1ull << 30)
+
+// a writable mapping as it was when the snapshot got taken. Without data
+// when it was too big, it's still known so diff doesn't call it new
+struct Region {
+  uint64_t start;
+  uint64_t end;
+  char *path;
+  uint8_t *data;
+};
+
+static struct {
+  bool is_taken;
+  struct Region *regions;
+  size_t count;
+  // the kernel clears soft-dirty bits for us, so pages written since have it
+  // set again. Without CONFIG_MEM_SOFT_DIRTY every page gets compared
+  bool has_soft_dirty;
+} snapshot;
+
+// set once a soft-dirty bit was ever seen, a page can't tell us otherwise
+static bool is_soft_dirty_supported;
+
+// changed bytes next to each other get reported as one range
+static struct {
+  const struct Region *region;
+  uint64_t start;
+  uint64_t end;
+  size_t count;
+  uint64_t bytes;
+} changes;
+
+static uint8_t batch[DIFF_BATCH_PAGES * PAGE_BYTES];
+
+static int open_proc(int pid, const char *name, int flags) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+  return open(path, flags);
+}
+
+void free_snapshot(void) {
+  for (size_t i = 0; i < snapshot.count; i++) {
+    free(snapshot.regions[i].path);
+    free(snapshot.regions[i].data);
+  }
+  free(snapshot.regions);
+  memset(&snapshot, 0, sizeof(snapshot));
+}
+
+// one pread for the entries of the whole range
+static uint64_t *read_pagemap(int fd, uint64_t start, uint64_t end) {
+  size_t size = (end - start) / PAGE_BYTES * sizeof(uint64_t);
+  uint64_t *entries = malloc(size ? size : 1);
+  assert(entries);
+
+  if (pread(fd, entries, size, start / PAGE_BYTES * sizeof(uint64_t)) !=
+      (ssize_t)size) {
+    free(entries);
+    return NULL;
+  }
+  return entries;
+}
+
+static void check_soft_dirty(int pagemap, const struct Region *region) {
+  uint64_t *entries = read_pagemap(pagemap, region->start, region->end);
+  if (!entries)
+    return;
+
+  for (size_t i = 0; i < (region->end - region->start) / PAGE_BYTES; i++) {
+    if (entries[i] & PM_SOFT_DIRTY) {
+      is_soft_dirty_supported = true;
+      break;
+    }
+  }
+  free(entries);
+}
+
+void take_snapshot(int pid) {
+  free_snapshot();
+  invalidate_mappings();
+
+  size_t count;
+  const struct Mapping *mappings = get_mappings(pid, &count);
+  snapshot.regions = calloc(count ? count : 1, sizeof(struct Region));
+  assert(snapshot.regions);
+
+  int pagemap = open_proc(pid, "pagemap", O_RDONLY);
+  uint64_t bytes = 0;
+  size_t copied = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    if (mappings[i].perms[1] != 'w')
+      continue;
+
+    struct Region *region = &snapshot.regions[snapshot.count++];
+    size_t size = mappings[i].end - mappings[i].start;
+    region->start = mappings[i].start;
+    region->end = mappings[i].end;
+    region->path = strdup(mappings[i].path);
+    region->data = size <= MAX_REGION_BYTES ? malloc(size) : NULL;
+    if (!region->data) {
+      printf("? Skipped 0x%lx-0x%lx, %zu MB is too big to copy.\n",
+             region->start, region->end, size >> 20);
+      continue;
+    }
+    copied++;
+
+    // whatever couldn't be read compares as zeroes
+    ssize_t got = read_memory(pid, region->start, region->data, size);
+    if (got < (ssize_t)size)
+      memset(region->data + (got > 0 ? got : 0), 0,
+             size - (got > 0 ? got : 0));
+    bytes += size;
+
+    if (pagemap != -1 && !is_soft_dirty_supported)
+      check_soft_dirty(pagemap, region);
+  }
+  if (pagemap != -1)
+    close(pagemap);
+
+  // after the copy, the tracee is stopped so nothing gets written in between
+  int clear_refs = open_proc(pid, "clear_refs", O_WRONLY);
+  snapshot.has_soft_dirty = is_soft_dirty_supported && clear_refs != -1 &&
+                            write(clear_refs, "4", 1) == 1;
+  if (clear_refs != -1)
+    close(clear_refs);
+
+  snapshot.is_taken = true;
+  printf("snapshot of %zu regions, %lu kB.\n", copied, bytes / 1024);
+  if (!snapshot.has_soft_dirty)
+    puts("no soft-dirty bits here, diff will compare every page.");
+}
+
+static void print_change(int pid) {
+  const struct Region *region = changes.region;
+  size_t length = changes.end - changes.start;
+  printf("   " YELLOW("0x%lx") " %8zu bytes", changes.start, length);
+
+  // small enough to be a variable, show what it was and is
+  if (length <= sizeof(uint64_t)) {
+    uint64_t then = 0, now = 0;
+    memcpy(&then, region->data + (changes.start - region->start), length);
+    read_memory(pid, changes.start, &now, length);
+    printf("  0x%lx → 0x%lx", then, now);
+  }
+  if (region->path[0])
+    printf("  %s", region->path);
+  putchar('\n');
+}
+
+static void flush_change(int pid) {
+  if (!changes.region)
+    return;
+
+  if (++changes.count <= DIFF_SHOWN)
+    print_change(pid);
+  changes.bytes += changes.end - changes.start;
+  changes.region = NULL;
+}
+
+static void note_change(int pid, const struct Region *region, uint64_t start,
+                        uint64_t end) {
+  if (changes.region == region && changes.end == start) {
+    changes.end = end;
+    return;
+  }
+  flush_change(pid);
+  changes.region = region;
+  changes.start = start;
+  changes.end = end;
+}
+
+// memcmp is vectorized and throws out the untouched pages of a dirty batch,
+// the rest narrows changes down a word at a time
+static void compare_page(int pid, const struct Region *region,
+                         uint64_t address, const uint8_t *now) {
+  const uint8_t *then = region->data + (address - region->start);
+  if (memcmp(then, now, PAGE_BYTES) == 0)
+    return;
+
+  for (size_t i = 0; i < PAGE_BYTES; i += sizeof(uint64_t)) {
+    uint64_t a, b;
+    memcpy(&a, then + i, sizeof(a));
+    memcpy(&b, now + i, sizeof(b));
+    if (a == b)
+      continue;
+
+    // little endian, the lowest differing byte comes first
+    uint64_t changed = a ^ b;
+    size_t first = __builtin_ctzll(changed) / 8;
+    size_t last = (63 - __builtin_clzll(changed)) / 8;
+    note_change(pid, region, address + i + first, address + i + last + 1);
+  }
+}
+
+// the whole batch in one process_vm_readv, page by page only past a failure
+static void compare_batch(int pid, const struct Region *region,
+                          const uint64_t *addresses, size_t count) {
+  struct iovec local = {batch, count * PAGE_BYTES};
+  struct iovec remote[DIFF_BATCH_PAGES];
+  for (size_t i = 0; i < count; i++)
+    remote[i] = (struct iovec){(void *)addresses[i], PAGE_BYTES};
+
+  ssize_t got = process_vm_readv(pid, &local, 1, remote, count, 0);
+  if (got > 0)
+    note_memory_read(got);
+
+  for (size_t i = 0; i < count; i++) {
+    uint8_t *page = batch + i * PAGE_BYTES;
+    if ((ssize_t)((i + 1) * PAGE_BYTES) > got &&
+        read_memory(pid, addresses[i], page, PAGE_BYTES) != PAGE_BYTES)
+      continue;
+    compare_page(pid, region, addresses[i], page);
+  }
+}
+
+// writable memory that wasn't there for the snapshot
+static void print_new_mappings(int pid) {
+  size_t count;
+  const struct Mapping *mappings = get_mappings(pid, &count);
+
+  for (size_t i = 0; i < count; i++) {
+    if (mappings[i].perms[1] != 'w')
+      continue;
+
+    const struct Region *region = NULL;
+    for (size_t j = 0; j < snapshot.count && !region; j++) {
+      if (snapshot.regions[j].start == mappings[i].start)
+        region = &snapshot.regions[j];
+    }
+
+    if (!region)
+      printf("   new  " YELLOW("0x%lx-0x%lx") "  %s\n", mappings[i].start,
+             mappings[i].end, mappings[i].path);
+    else if (mappings[i].end > region->end)
+      printf("   grew " YELLOW("0x%lx-0x%lx") "  %s\n", region->end,
+             mappings[i].end, mappings[i].path);
+  }
+}
+
+// only the soft-dirty pages get read and compared, so the cost follows what
+// the tracee wrote rather than how much it has mapped
+void diff_snapshot(int pid) {
+  if (!snapshot.is_taken) {
+    puts("? No snapshot, take one first.");
+    return;
+  }
+
+  invalidate_mappings();
+  int pagemap =
+      snapshot.has_soft_dirty ? open_proc(pid, "pagemap", O_RDONLY) : -1;
+  memset(&changes, 0, sizeof(changes));
+  size_t dirty_pages = 0, pages = 0;
+
+  for (size_t i = 0; i < snapshot.count; i++) {
+    const struct Region *region = &snapshot.regions[i];
+    const struct Mapping *mapping = find_mapping(pid, region->start);
+    if (!mapping || !region->data)
+      continue;
+
+    // the part of it that's still there
+    uint64_t end = mapping->end < region->end ? mapping->end : region->end;
+    size_t region_pages = (end - region->start) / PAGE_BYTES;
+    pages += region_pages;
+
+    uint64_t *entries =
+        pagemap != -1 ? read_pagemap(pagemap, region->start, end) : NULL;
+
+    uint64_t addresses[DIFF_BATCH_PAGES];
+    size_t count = 0;
+    for (size_t j = 0; j < region_pages; j++) {
+      if (entries && !(entries[j] & PM_SOFT_DIRTY))
+        continue;
+
+      dirty_pages++;
+      addresses[count++] = region->start + j * PAGE_BYTES;
+      if (count == DIFF_BATCH_PAGES) {
+        compare_batch(pid, region, addresses, count);
+        count = 0;
+      }
+    }
+    if (count > 0)
+      compare_batch(pid, region, addresses, count);
+    free(entries);
+  }
+  flush_change(pid);
+
+  if (pagemap != -1)
+    close(pagemap);
+
+  if (changes.count > DIFF_SHOWN)
+    printf("   ... and %zu more.\n", changes.count - DIFF_SHOWN);
+  print_new_mappings(pid);
+  printf("%zu changes, %lu bytes, %zu of %zu pages %s.\n", changes.count,
+         changes.bytes, dirty_pages, pages,
+         snapshot.has_soft_dirty ? "dirty" : "compared");
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+void take_snapshot(int pid);
+void diff_snapshot(int pid);
+void free_snapshot(void);
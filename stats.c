@@ -0,0 +1,243 @@
+#include "stats.h"
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#define LATENCY_BUCKETS 32
+
+static const struct {
+  enum __ptrace_request request;
+  const char *name;
+} request_names[] = {
+    {PTRACE_PEEKDATA, "peekdata"},     {PTRACE_PEEKUSER, "peekuser"},
+    {PTRACE_POKEDATA, "pokedata"},     {PTRACE_POKEUSER, "pokeuser"},
+    {PTRACE_CONT, "cont"},             {PTRACE_KILL, "kill"},
+    {PTRACE_SINGLESTEP, "singlestep"}, {PTRACE_GETREGS, "getregs"},
+    {PTRACE_SETREGS, "setregs"},       {PTRACE_GETFPREGS, "getfpregs"},
+    {PTRACE_SETFPREGS, "setfpregs"},   {PTRACE_SYSCALL, "syscall"},
+    {PTRACE_SETOPTIONS, "setoptions"}, {PTRACE_GETSIGINFO, "getsiginfo"},
+    {PTRACE_GETREGSET, "getregset"},   {PTRACE_SETREGSET, "setregset"},
+    {PTRACE_INTERRUPT, "interrupt"},   {PTRACE_SEIZE, "seize"},
+};
+
+static const char *cause_names[STOP_CAUSES_COUNT] = {
+    "exec",      "breakpoint", "step",  "syscall", "signal",
+    "interrupt", "exit",       "clone", "fork",    "vfork-done",
+    "group-stop",
+};
+
+static const char *phase_names[PHASES_COUNT] = {
+    "tracer", "tracee", "render", "prompt",
+};
+
+static struct {
+  uint64_t requests[sizeof(request_names) / sizeof(request_names[0])];
+  uint64_t other_requests;
+  uint64_t waits;
+  uint64_t bytes_read;
+  uint64_t stops[STOP_CAUSES_COUNT];
+  uint64_t phase_ns[PHASES_COUNT];
+  // stop-to-resume latency, bucket i holds [2^i, 2^(i+1)) microseconds
+  uint64_t latency[LATENCY_BUCKETS];
+} stats;
+
+static enum Phase phase = PHASE_TRACER;
+static uint64_t phase_start;
+static uint64_t stop_time;
+// PTRACE_TRACEME (0) until the first resume
+static enum __ptrace_request last_resume;
+static const char *stats_path = NULL;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void enter_phase(enum Phase next) {
+  uint64_t now = now_ns();
+  if (phase_start)
+    stats.phase_ns[phase] += now - phase_start;
+  phase_start = now;
+  phase = next;
+}
+
+static void note_resume(enum __ptrace_request request) {
+  last_resume = request;
+  if (!stop_time)
+    return;
+
+  uint64_t us = (now_ns() - stop_time) / 1000;
+  size_t bucket = 0;
+  while (us > 1 && bucket < LATENCY_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  stats.latency[bucket]++;
+  stop_time = 0;
+}
+
+long counted_ptrace(enum __ptrace_request request, pid_t pid, uint64_t addr,
+                    uint64_t data) {
+  bool is_counted = false;
+  for (size_t i = 0; i < sizeof(request_names) / sizeof(request_names[0]);
+       i++) {
+    if (request_names[i].request == request) {
+      stats.requests[i]++;
+      is_counted = true;
+      break;
+    }
+  }
+  if (!is_counted)
+    stats.other_requests++;
+
+  switch (request) {
+  case PTRACE_CONT:
+  case PTRACE_SINGLESTEP:
+  case PTRACE_SYSCALL:
+    note_resume(request);
+    break;
+  case PTRACE_PEEKDATA:
+  case PTRACE_PEEKTEXT:
+    stats.bytes_read += sizeof(long);
+    break;
+  default:
+    break;
+  }
+
+  return ptrace(request, pid, addr, data);
+}
+
+pid_t counted_waitpid(pid_t pid, int *status, int options) {
+  stats.waits++;
+  enter_phase(PHASE_TRACEE);
+  pid_t res = waitpid(pid, status, options);
+  enter_phase(PHASE_TRACER);
+  // a WNOHANG poll may find nothing to report
+  if (res > 0)
+    stop_time = phase_start;
+  return res;
+}
+
+void note_memory_read(uint64_t bytes) { stats.bytes_read += bytes; }
+
+enum StopCause note_stop(int status) {
+  enum StopCause cause;
+  int signal = WSTOPSIG(status);
+
+  // PTRACE_INTERRUPT stops with SIGTRAP, job control with the stop signal
+  if (status >> 16 == PTRACE_EVENT_STOP)
+    cause = signal == SIGTRAP ? STOP_INTERRUPT : STOP_GROUP;
+  else if (status >> 16 == PTRACE_EVENT_EXEC)
+    cause = STOP_EXEC;
+  else if (status >> 16 == PTRACE_EVENT_EXIT)
+    cause = STOP_EXIT;
+  else if (status >> 16 == PTRACE_EVENT_CLONE)
+    cause = STOP_CLONE;
+  else if (status >> 16 == PTRACE_EVENT_FORK ||
+           status >> 16 == PTRACE_EVENT_VFORK)
+    cause = STOP_FORK;
+  else if (status >> 16 == PTRACE_EVENT_VFORK_DONE)
+    cause = STOP_VFORK_DONE;
+  else if (signal == (SIGTRAP | 0x80))
+    cause = STOP_SYSCALL;
+  else if (signal != SIGTRAP)
+    cause = STOP_SIGNAL;
+  else if (!last_resume)
+    cause = STOP_EXEC;
+  else if (last_resume == PTRACE_SINGLESTEP)
+    cause = STOP_STEP;
+  else
+    cause = STOP_BREAKPOINT;
+
+  stats.stops[cause]++;
+  return cause;
+}
+
+enum __ptrace_request get_last_resume(void) { return last_resume; }
+
+void print_stats(void) {
+  enter_phase(phase);
+
+  puts("ptrace requests:");
+  for (size_t i = 0; i < sizeof(request_names) / sizeof(request_names[0]);
+       i++) {
+    if (stats.requests[i])
+      printf("   %-12s %lu\n", request_names[i].name, stats.requests[i]);
+  }
+  if (stats.other_requests)
+    printf("   %-12s %lu\n", "other", stats.other_requests);
+  printf("   %-12s %lu\n", "waitpid", stats.waits);
+
+  printf("memory read: %lu bytes\n", stats.bytes_read);
+
+  puts("stops:");
+  for (size_t i = 0; i < STOP_CAUSES_COUNT; i++) {
+    printf("   %-12s %lu\n", cause_names[i], stats.stops[i]);
+  }
+
+  puts("time:");
+  for (size_t i = 0; i < PHASES_COUNT; i++) {
+    printf("   %-12s %.3f ms\n", phase_names[i], stats.phase_ns[i] / 1e6);
+  }
+
+  puts("stop-to-resume latency:");
+  for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+    if (stats.latency[i])
+      printf("   < %-10lu us %lu\n", 2ul << i, stats.latency[i]);
+  }
+}
+
+void set_stats_path(const char *path) { stats_path = path; }
+
+const char *get_stats_path(void) { return stats_path; }
+
+void dump_stats(void) {
+  if (!stats_path)
+    return;
+
+  FILE *file = fopen(stats_path, "w");
+  if (!file) {
+    perror(stats_path);
+    return;
+  }
+
+  enter_phase(phase);
+
+  fprintf(file, "{\n  \"ptrace\": {");
+  const char *sep = "";
+  for (size_t i = 0; i < sizeof(request_names) / sizeof(request_names[0]);
+       i++) {
+    fprintf(file, "%s\"%s\": %lu", sep, request_names[i].name,
+            stats.requests[i]);
+    sep = ", ";
+  }
+  fprintf(file, ", \"other\": %lu, \"waitpid\": %lu},\n", stats.other_requests,
+          stats.waits);
+
+  fprintf(file, "  \"bytes_read\": %lu,\n", stats.bytes_read);
+
+  fprintf(file, "  \"stops\": {");
+  for (size_t i = 0; i < STOP_CAUSES_COUNT; i++) {
+    fprintf(file, "%s\"%s\": %lu", i ? ", " : "", cause_names[i],
+            stats.stops[i]);
+  }
+  fprintf(file, "},\n");
+
+  fprintf(file, "  \"time_ns\": {");
+  for (size_t i = 0; i < PHASES_COUNT; i++) {
+    fprintf(file, "%s\"%s\": %lu", i ? ", " : "", phase_names[i],
+            stats.phase_ns[i]);
+  }
+  fprintf(file, "},\n");
+
+  fprintf(file, "  \"latency_us_log2\": [");
+  for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+    fprintf(file, "%s%lu", i ? ", " : "", stats.latency[i]);
+  }
+  fprintf(file, "]\n}\n");
+
+  fclose(file);
+}
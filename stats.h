@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+
+enum StopCause : uint8_t {
+  STOP_EXEC,
+  STOP_BREAKPOINT,
+  STOP_STEP,
+  STOP_SYSCALL,
+  STOP_SIGNAL,
+  STOP_INTERRUPT,
+  STOP_EXIT,
+  STOP_CLONE,
+  STOP_FORK,
+  STOP_VFORK_DONE,
+  STOP_GROUP,
+  STOP_CAUSES_COUNT
+};
+
+enum Phase : uint8_t {
+  PHASE_TRACER,
+  PHASE_TRACEE,
+  PHASE_RENDER,
+  PHASE_PROMPT,
+  PHASES_COUNT
+};
+
+// every ptrace/waitpid in the tracer goes through these so they get counted
+#define PTRACE(request, pid, addr, data)                                       \
+  counted_ptrace(request, pid, (uint64_t)(addr), (uint64_t)(data))
+#define WAITPID(pid, status, options) counted_waitpid(pid, status, options)
+
+#define TRACE_OPTIONS                                                          \
+  (PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL)
+
+long counted_ptrace(enum __ptrace_request request, pid_t pid, uint64_t addr,
+                    uint64_t data);
+pid_t counted_waitpid(pid_t pid, int *status, int options);
+
+void note_memory_read(uint64_t bytes);
+enum StopCause note_stop(int status);
+enum __ptrace_request get_last_resume(void);
+void enter_phase(enum Phase phase);
+void print_stats(void);
+void set_stats_path(const char *path);
+const char *get_stats_path(void);
+void dump_stats(void);
@@ -0,0 +1,219 @@
+#include "stepping.h"
+#include "breakpoints.h"
+#include "cfg.h"
+#include "lines.h"
+#include "maps.h"
+#include "signals.h"
+#include <stdio.h>
+#include <string.h>
+
+// longest x86 instruction, for telling a call from any other push
+#define MAX_CALL_LENGTH 15
+
+// a line step is a run of single steps, decided one stop at a time so the
+// event loop stays in charge and ^C still gets through
+static struct {
+  bool is_active;
+  enum StepKind kind;
+  const char *file;
+  uint32_t line;
+  uint64_t prev_rip;
+  uint64_t prev_rsp;
+
+  // running a call we don't step through back to its return address
+  bool is_returning;
+  uint64_t return_address;
+  // where the return address sits, anything at or below is still the callee
+  uint64_t call_rsp;
+  int breakpoint;
+} step;
+
+// until and advance run to the exits of a loop on temporary breakpoints
+static struct {
+  bool is_active;
+  uint64_t exits[MAX_LOOP_EXITS];
+  int breakpoints[MAX_LOOP_EXITS];
+  size_t count;
+  // the frame the loop runs in, deeper ones are recursion
+  uint64_t rsp;
+} leave;
+
+static void resume(int pid, const struct user_regs_struct *regs) {
+  step.prev_rip = regs->rip;
+  step.prev_rsp = regs->rsp;
+  PTRACE(PTRACE_SINGLESTEP, pid, 0, take_signal());
+}
+
+// breaks on the return address when a debug register is free, otherwise
+// single steps through the whole call
+static void run_to_return(int pid, const struct user_regs_struct *regs) {
+  step.is_returning = true;
+  step.return_address = PTRACE(PTRACE_PEEKDATA, pid, regs->rsp, 0);
+  step.call_rsp = regs->rsp;
+  step.breakpoint =
+      set_breakpoint(pid, step.return_address, BP_EXECUTE, 1);
+
+  if (step.breakpoint == -1) {
+    resume(pid, regs);
+    return;
+  }
+  apply_breakpoints(pid);
+  // the callee may map or unmap anything, as after a continue
+  invalidate_mappings();
+  PTRACE(PTRACE_CONT, pid, 0, take_signal());
+}
+
+static void stop_returning(int pid) {
+  if (step.is_returning && step.breakpoint != -1) {
+    remove_breakpoint(pid, step.breakpoint);
+    apply_breakpoints(pid);
+  }
+  step.is_returning = false;
+}
+
+bool start_line_step(int pid, enum StepKind kind) {
+  struct user_regs_struct regs;
+  PTRACE(PTRACE_GETREGS, pid, 0, &regs);
+
+  struct SourceLine line;
+  if (!find_line(pid, regs.rip, &line))
+    return false;
+
+  step.is_active = true;
+  step.is_returning = false;
+  step.kind = kind;
+  step.file = line.file;
+  step.line = line.line;
+  resume(pid, &regs);
+  return true;
+}
+
+void cancel_line_step(int pid) {
+  if (!step.is_active)
+    return;
+  stop_returning(pid);
+  step.is_active = false;
+}
+
+// called on every stop, true when the step went on and the tracee is running
+bool continue_line_step(int pid, const struct user_regs_struct *regs,
+                        enum StopCause cause) {
+  if (!step.is_active)
+    return false;
+
+  // a signal, ^C, or a breakpoint that isn't ours ends it where it is
+  if (cause != STOP_STEP && cause != STOP_BREAKPOINT) {
+    cancel_line_step(pid);
+    return false;
+  }
+
+  if (step.is_returning) {
+    if (regs->rsp <= step.call_rsp) {
+      if (step.breakpoint == -1) {
+        resume(pid, regs);
+        return true;
+      }
+      // recursion brought us to the return address of a deeper frame
+      if (cause == STOP_BREAKPOINT && regs->rip == step.return_address) {
+        PTRACE(PTRACE_CONT, pid, 0, 0);
+        return true;
+      }
+      cancel_line_step(pid);
+      return false;
+    }
+    stop_returning(pid);
+  } else if (cause != STOP_STEP) {
+    cancel_line_step(pid);
+    return false;
+  }
+
+  struct SourceLine line;
+  bool has_line = find_line(pid, regs->rip, &line);
+
+  uint64_t return_address = PTRACE(PTRACE_PEEKDATA, pid, regs->rsp, 0);
+  bool is_call = regs->rsp == step.prev_rsp - 8 &&
+                 return_address > step.prev_rip &&
+                 return_address <= step.prev_rip + MAX_CALL_LENGTH;
+  if (is_call && (step.kind == STEP_OVER || !has_line)) {
+    run_to_return(pid, regs);
+    return true;
+  }
+
+  // off the end of the source, say returning out of main
+  if (!has_line) {
+    step.is_active = false;
+    return false;
+  }
+
+  if (line.address == regs->rip && line.is_stmt &&
+      (line.line != step.line || strcmp(line.file, step.file) != 0)) {
+    step.is_active = false;
+    return false;
+  }
+
+  resume(pid, regs);
+  return true;
+}
+
+static void remove_exits(int pid, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    remove_breakpoint(pid, leave.breakpoints[i]);
+  apply_breakpoints(pid);
+}
+
+bool start_loop_exit(int pid, bool is_outermost) {
+  struct user_regs_struct regs;
+  PTRACE(PTRACE_GETREGS, pid, 0, &regs);
+
+  size_t count = find_loop_exits(pid, regs.rip, is_outermost, leave.exits);
+  if (count == 0)
+    return false;
+  if (count > MAX_BREAKPOINTS) {
+    printf("? The loop has %zu exits, more than there are breakpoints.\n",
+           count);
+    return false;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    leave.breakpoints[i] = set_breakpoint(pid, leave.exits[i], BP_EXECUTE, 1);
+    if (leave.breakpoints[i] == -1) {
+      remove_exits(pid, i);
+      printf("? The loop has %zu exits, not enough free breakpoints.\n",
+             count);
+      return false;
+    }
+  }
+
+  leave.is_active = true;
+  leave.count = count;
+  leave.rsp = regs.rsp;
+  apply_breakpoints(pid);
+  PTRACE(PTRACE_CONT, pid, 0, take_signal());
+  return true;
+}
+
+void cancel_loop_exit(int pid) {
+  if (!leave.is_active)
+    return;
+  remove_exits(pid, leave.count);
+  leave.is_active = false;
+}
+
+// called on every stop, true when the tracee went on running
+bool continue_loop_exit(int pid, const struct user_regs_struct *regs,
+                        enum StopCause cause) {
+  if (!leave.is_active)
+    return false;
+
+  bool is_exit = false;
+  for (size_t i = 0; i < leave.count; i++)
+    is_exit |= regs->rip == leave.exits[i];
+
+  // a recursive call running its own copy of the loop
+  if (cause == STOP_BREAKPOINT && is_exit && regs->rsp < leave.rsp) {
+    PTRACE(PTRACE_CONT, pid, 0, 0);
+    return true;
+  }
+  cancel_loop_exit(pid);
+  return false;
+}
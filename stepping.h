@@ -0,0 +1,16 @@
+#pragma once
+
+#include "stats.h"
+#include <stdbool.h>
+#include <sys/user.h>
+
+enum StepKind : uint8_t { STEP_INTO, STEP_OVER };
+
+bool start_line_step(int pid, enum StepKind kind);
+bool continue_line_step(int pid, const struct user_regs_struct *regs,
+                        enum StopCause cause);
+void cancel_line_step(int pid);
+bool start_loop_exit(int pid, bool is_outermost);
+bool continue_loop_exit(int pid, const struct user_regs_struct *regs,
+                        enum StopCause cause);
+void cancel_loop_exit(int pid);
@@ -0,0 +1,168 @@
+#include "symbols.h"
+#include "maps.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool is_valid_elf(const uint8_t *elf, size_t size) {
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)elf;
+  return size >= sizeof(Elf64_Ehdr) && memcmp(elf, ELFMAG, SELFMAG) == 0 &&
+         elf[EI_CLASS] == ELFCLASS64 &&
+         ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) <= size &&
+         ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) <= size;
+}
+
+// shared objects and PIEs get loaded wherever, everything else where it was
+// linked
+static uint64_t find_bias(const uint8_t *elf, uint64_t start) {
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)elf;
+  if (ehdr->e_type != ET_DYN)
+    return 0;
+
+  const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(elf + ehdr->e_phoff);
+  uint64_t first_vaddr = UINT64_MAX;
+  for (size_t i = 0; i < ehdr->e_phnum; i++) {
+    if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_vaddr < first_vaddr)
+      first_vaddr = phdrs[i].p_vaddr;
+  }
+  return start - (first_vaddr & ~0xfffull);
+}
+
+// what a symbol table walk is looking for, by name or by address
+struct Query {
+  const char *name;
+  uint64_t value;
+};
+
+static bool matches(const struct Query *query, const Elf64_Sym *sym,
+                    const char *name) {
+  if (query->name)
+    return strcmp(name, query->name) == 0;
+  return query->value >= sym->st_value &&
+         query->value < sym->st_value + sym->st_size;
+}
+
+// .symtab when the file wasn't stripped, .dynsym otherwise
+static const Elf64_Sym *lookup(const uint8_t *elf, size_t size,
+                               const struct Query *query, const char **name) {
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)elf;
+  const Elf64_Shdr *shdrs = (const Elf64_Shdr *)(elf + ehdr->e_shoff);
+
+  for (size_t i = 0; i < ehdr->e_shnum; i++) {
+    const Elf64_Shdr *symtab = &shdrs[i];
+    if ((symtab->sh_type != SHT_SYMTAB && symtab->sh_type != SHT_DYNSYM) ||
+        symtab->sh_link >= ehdr->e_shnum ||
+        symtab->sh_offset + symtab->sh_size > size)
+      continue;
+
+    const Elf64_Shdr *strtab = &shdrs[symtab->sh_link];
+    if (strtab->sh_offset + strtab->sh_size > size)
+      continue;
+
+    const Elf64_Sym *syms = (const Elf64_Sym *)(elf + symtab->sh_offset);
+    const char *strs = (const char *)(elf + strtab->sh_offset);
+    size_t count = symtab->sh_size / sizeof(Elf64_Sym);
+
+    for (size_t j = 0; j < count; j++) {
+      // imports and ifunc resolvers aren't the function itself
+      if (syms[j].st_shndx == SHN_UNDEF ||
+          ELF64_ST_TYPE(syms[j].st_info) != STT_FUNC ||
+          syms[j].st_name >= strtab->sh_size)
+        continue;
+
+      if (matches(query, &syms[j], strs + syms[j].st_name)) {
+        *name = strs + syms[j].st_name;
+        return &syms[j];
+      }
+    }
+  }
+  return NULL;
+}
+
+// the file behind a mapping, the caller munmaps it
+static void *map_file(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+
+  struct stat st;
+  fstat(fd, &st);
+  void *elf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (elf == MAP_FAILED)
+    return NULL;
+
+  if (!is_valid_elf(elf, st.st_size)) {
+    munmap(elf, st.st_size);
+    return NULL;
+  }
+  *size = st.st_size;
+  return elf;
+}
+
+// the first definition in mapping order, the executable before its libraries
+bool find_symbol(int pid, const char *name, uint64_t *address) {
+  size_t count;
+  const struct Mapping *mappings = get_mappings(pid, &count);
+
+  for (size_t i = 0; i < count; i++) {
+    if (mappings[i].offset != 0 || mappings[i].path[0] != '/')
+      continue;
+
+    size_t size;
+    uint8_t *elf = map_file(mappings[i].path, &size);
+    if (!elf)
+      continue;
+
+    const char *found;
+    const Elf64_Sym *sym = lookup(elf, size, &(struct Query){name, 0}, &found);
+    if (sym)
+      *address = sym->st_value + find_bias(elf, mappings[i].start);
+
+    munmap(elf, size);
+    if (sym)
+      return true;
+  }
+  return false;
+}
+
+// the function symbol whose extent holds the address
+bool find_function(int pid, uint64_t address, struct Function *function) {
+  const struct Mapping *mapping = find_mapping(pid, address);
+  if (!mapping || mapping->path[0] != '/')
+    return false;
+
+  // the bias comes from where the start of the file got mapped
+  size_t count;
+  const struct Mapping *mappings = get_mappings(pid, &count);
+  const struct Mapping *first = NULL;
+  for (size_t i = 0; i < count && !first; i++) {
+    if (mappings[i].offset == 0 && strcmp(mappings[i].path, mapping->path) == 0)
+      first = &mappings[i];
+  }
+  if (!first)
+    return false;
+
+  size_t size;
+  uint8_t *elf = map_file(first->path, &size);
+  if (!elf)
+    return false;
+
+  uint64_t bias = find_bias(elf, first->start);
+  const char *name;
+  const Elf64_Sym *sym =
+      lookup(elf, size, &(struct Query){NULL, address - bias}, &name);
+  if (sym) {
+    function->start = sym->st_value + bias;
+    function->end = function->start + sym->st_size;
+    snprintf(function->name, sizeof(function->name), "%s", name);
+  }
+
+  munmap(elf, size);
+  return sym != NULL;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// a defined function, the name cut short to fit
+struct Function {
+  uint64_t start;
+  uint64_t end;
+  char name[64];
+};
+
+bool find_symbol(int pid, const char *name, uint64_t *address);
+bool find_function(int pid, uint64_t address, struct Function *function);
@@ -0,0 +1,228 @@
+#include "xstate.h"
+#include "render.h"
+#include "stats.h"
+#include "ui.h"
+#include <cpuid.h>
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+
+#define XSAVE_MAX_SIZE 4096
+
+// legacy FXSAVE region
+#define FXSAVE_MXCSR 24
+#define FXSAVE_ST0 32
+#define FXSAVE_XMM0 160
+// ptrace puts XCR0 at the start of the software reserved bytes
+#define FXSAVE_SW_XCR0 464
+#define XSAVE_HEADER_BV 512
+
+enum XFeature : uint8_t {
+  XFEATURE_YMM = 2,
+  XFEATURE_OPMASK = 5,
+  XFEATURE_ZMM_HI256 = 6,
+  XFEATURE_HI16_ZMM = 7,
+};
+
+static uint8_t xsave[XSAVE_MAX_SIZE];
+static uint64_t xstate_bv;
+static uint64_t xfeatures;
+static bool is_cached = false;
+static bool is_shown = false;
+
+static const struct {
+  const char *prefix;
+  enum Register base;
+  size_t count;
+} xreg_names[] = {
+    {"st", REG_ST0, 8},    {"xmm", REG_XMM0, 32}, {"ymm", REG_YMM0, 32},
+    {"zmm", REG_ZMM0, 32}, {"k", REG_K0, 8},
+};
+
+bool parse_xreg(const char *name, size_t length, enum Register *reg) {
+  if (length == 5 && strncmp(name, "mxcsr", 5) == 0) {
+    *reg = REG_MXCSR;
+    return true;
+  }
+
+  for (size_t i = 0; i < sizeof(xreg_names) / sizeof(xreg_names[0]); i++) {
+    size_t prefix_len = strlen(xreg_names[i].prefix);
+    if (length <= prefix_len || strncmp(name, xreg_names[i].prefix, prefix_len))
+      continue;
+
+    char *end;
+    size_t index = strtoul(name + prefix_len, &end, 10);
+    if (end != name + length || index >= xreg_names[i].count)
+      return false;
+
+    *reg = xreg_names[i].base + index;
+    return true;
+  }
+
+  return false;
+}
+
+// the offsets of the extended components aren't architectural, ask the CPU
+static uint32_t component_offset(enum XFeature feature) {
+  static uint32_t offsets[XFEATURE_HI16_ZMM + 1];
+
+  if (!offsets[feature]) {
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid_count(0xd, feature, &eax, &ebx, &ecx, &edx))
+      offsets[feature] = ebx;
+  }
+
+  return offsets[feature];
+}
+
+static void fetch_xstate(int pid) {
+  if (is_cached)
+    return;
+
+  struct iovec iov = {xsave, sizeof(xsave)};
+  memset(xsave, 0, sizeof(xsave));
+
+  if (PTRACE(PTRACE_GETREGSET, pid, NT_X86_XSTATE, &iov) == -1) {
+    // no XSAVE support, the legacy region is all we get
+    iov.iov_len = 512;
+    PTRACE(PTRACE_GETFPREGS, pid, 0, xsave);
+  }
+
+  memcpy(&xfeatures, xsave + FXSAVE_SW_XCR0, sizeof(xfeatures));
+  if (iov.iov_len > XSAVE_HEADER_BV)
+    memcpy(&xstate_bv, xsave + XSAVE_HEADER_BV, sizeof(xstate_bv));
+  else
+    xfeatures = xstate_bv = 0;
+
+  is_cached = true;
+}
+
+void invalidate_xstate(void) { is_cached = false; }
+
+// the legacy 512 byte FXSAVE region, valid until the next stop
+const uint8_t *get_fxsave(int pid) {
+  fetch_xstate(pid);
+  return xsave;
+}
+
+static bool has_feature(enum XFeature feature) {
+  return xfeatures & (1 << feature);
+}
+
+// components in their init state are all zeroes and may not be written out
+static const uint8_t *component(enum XFeature feature) {
+  if (!(xfeatures & xstate_bv & (1 << feature)))
+    return NULL;
+  return xsave + component_offset(feature);
+}
+
+// copies the full width of a vector register, returns its size in bytes
+static size_t read_vector(enum Register reg, uint8_t out[64]) {
+  size_t index = (reg - REG_XMM0) % 32;
+  size_t width = reg >= REG_ZMM0 ? 64 : reg >= REG_YMM0 ? 32 : 16;
+
+  const uint8_t *upper;
+
+  memset(out, 0, 64);
+
+  if (index >= 16) {
+    if ((upper = component(XFEATURE_HI16_ZMM)))
+      memcpy(out, upper + (index - 16) * 64, width);
+    return width;
+  }
+
+  memcpy(out, xsave + FXSAVE_XMM0 + index * 16, 16);
+
+  if (width >= 32 && (upper = component(XFEATURE_YMM)))
+    memcpy(out + 16, upper + index * 16, 16);
+
+  if (width == 64 && (upper = component(XFEATURE_ZMM_HI256)))
+    memcpy(out + 32, upper + index * 32, 32);
+
+  return width;
+}
+
+static long double read_st(enum Register reg) {
+  long double value = 0;
+  memcpy(&value, xsave + FXSAVE_ST0 + (reg - REG_ST0) * 16, 10);
+  return value;
+}
+
+uint64_t get_xreg(int pid, enum Register reg) {
+  fetch_xstate(pid);
+
+  if (reg == REG_MXCSR) {
+    uint32_t mxcsr;
+    memcpy(&mxcsr, xsave + FXSAVE_MXCSR, sizeof(mxcsr));
+    return mxcsr;
+  }
+
+  if (reg >= REG_ST0 && reg < REG_XMM0) {
+    return (int64_t)read_st(reg);
+  }
+
+  if (reg >= REG_K0) {
+    uint64_t mask = 0;
+    const uint8_t *opmask = component(XFEATURE_OPMASK);
+    if (opmask)
+      memcpy(&mask, opmask + (reg - REG_K0) * 8, 8);
+    return mask;
+  }
+
+  // vector registers evaluate to their low quadword
+  uint8_t vector[64];
+  read_vector(reg, vector);
+
+  uint64_t value;
+  memcpy(&value, vector, sizeof(value));
+  return value;
+}
+
+void toggle_xregs(void) { is_shown = !is_shown; }
+
+bool xregs_shown(void) { return is_shown; }
+
+void draw_xregs(int pid) {
+  fetch_xstate(pid);
+
+  frame_printf("   " BOLD("mxcsr") "\t0x%lx\n", get_xreg(pid, REG_MXCSR));
+
+  for (size_t i = 0; i < 8; i++) {
+    frame_printf("   " BOLD("st%zu") "\t%Lg\n", i, read_st(REG_ST0 + i));
+  }
+
+  enum Register base = REG_XMM0;
+  size_t count = 16;
+
+  if (has_feature(XFEATURE_ZMM_HI256)) {
+    base = REG_ZMM0;
+    count = 32;
+  } else if (has_feature(XFEATURE_YMM)) {
+    base = REG_YMM0;
+  }
+
+  const char *prefix = base == REG_ZMM0 ? "zmm" : base == REG_YMM0 ? "ymm" : "xmm";
+
+  for (size_t i = 0; i < count; i++) {
+    uint8_t vector[64];
+    size_t width = read_vector(base + i, vector);
+
+    frame_printf("   " BOLD("%s%zu") "\t0x", prefix, i);
+    // most significant quadword first, like any other number
+    for (size_t q = width / 8; q > 0; q--) {
+      uint64_t quad;
+      memcpy(&quad, vector + (q - 1) * 8, sizeof(quad));
+      frame_printf(q == width / 8 ? "%016lx" : "_%016lx", quad);
+    }
+    frame_printf("\n");
+  }
+
+  if (has_feature(XFEATURE_OPMASK)) {
+    for (size_t i = 0; i < 8; i++) {
+      frame_printf("   " BOLD("k%zu") "\t0x%lx\n", i, get_xreg(pid, REG_K0 + i));
+    }
+  }
+}
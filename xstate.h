@@ -0,0 +1,13 @@
+#pragma once
+
+#include "lexer.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+bool parse_xreg(const char *name, size_t length, enum Register *reg);
+uint64_t get_xreg(int pid, enum Register reg);
+const uint8_t *get_fxsave(int pid);
+void draw_xregs(int pid);
+void toggle_xregs(void);
+bool xregs_shown(void);
+void invalidate_xstate(void);